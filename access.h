@@ -0,0 +1,17 @@
+#ifndef ACCESS_H
+#define ACCESS_H
+
+#include <cstdint>
+
+// trace addresses are kept at full width, a CacheSimulator only narrows them
+// to its tag type
+typedef uint64_t Address;
+
+// one decoded trace record
+struct Access {
+    Address address;
+    char operation;
+    unsigned char size;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include "bench.h"
+#include "cache.h"
+
+// the configs every benchmark run covers. changing them makes results
+// incomparable with older runs, so only add to the end
+static const char* const BENCH_CONFIGS[][6] = {
+    {"256", "4", "16", "write-allocate", "write-back", "lru"},
+    {"1024", "1", "16", "write-allocate", "write-back", "lru"},
+    {"64", "16", "64", "write-allocate", "write-back", "lru"},
+    {"16", "64", "16", "write-allocate", "write-back", "lru"},
+    {"256", "4", "16", "no-write-allocate", "write-through", "fifo"},
+    {"256", "8", "16", "write-allocate", "write-through", "plru"},
+    {"256", "4", "16", "write-allocate", "write-back", "srrip"},
+    {"1024", "8", "64", "write-allocate", "write-back", "random"},
+};
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printRow(const std::string& trace, const char* phase, const std::string& config, size_t accesses,
+                     double time, const OutputOptions& output, std::ostream& out) {
+    double rate = time > 0 ? accesses / time : 0;
+    if (output.format == FORMAT_JSON) {
+        out << "{\"trace\": \"" << trace << "\", \"phase\": \"" << phase << "\", \"config\": \"" << config
+            << "\", \"accesses\": " << accesses << ", \"seconds\": " << time
+            << ", \"accesses_per_second\": " << uint64_t(rate) << "}" << std::endl;
+    } else {
+        out << trace << "," << phase << "," << config << "," << accesses << "," << time << ","
+            << uint64_t(rate) << std::endl;
+    }
+}
+
+bool runBenchmark(const std::vector<std::string>& traces, const TraceOptions& input,
+                  const OutputOptions& output, std::ostream& out) {
+    std::vector<CacheConfig> configs;
+    for (const auto& args : BENCH_CONFIGS) {
+        CacheConfig config;
+        parseCacheConfig(std::vector<std::string>(args, args + 6), config, std::cerr);
+        configs.push_back(config);
+    }
+
+    if (output.format != FORMAT_JSON) {
+        out << "trace,phase,config,accesses,seconds,accesses_per_second" << std::endl;
+    }
+    for (const std::string& path : traces) {
+        TraceOptions options = input;
+        options.path = path;
+        if (TraceFile(path).fd() < 0) {
+            std::cerr << "could not open trace file " << path << std::endl;
+            return false;
+        }
+
+        std::vector<Access> trace;
+        double best = 0;
+        for (int i = 0; i < BENCH_REPEATS; i++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!loadTrace(options, trace)) {
+                return false;
+            }
+            double time = seconds(start);
+            best = i == 0 ? time : std::min(best, time);
+        }
+        printRow(path, "parse", "", trace.size(), best, output, out);
+
+        for (const CacheConfig& config : configs) {
+            for (int i = 0; i < BENCH_REPEATS; i++) {
+                // a fresh cache each time, so every run starts cold
+                std::unique_ptr<Cache> cache = makeCache(config);
+                auto start = std::chrono::steady_clock::now();
+                cache->processBatch(trace.data(), trace.size());
+                double time = seconds(start);
+                best = i == 0 ? time : std::min(best, time);
+            }
+            printRow(path, "simulate", formatCacheConfig(config), trace.size(), best, output, out);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "report.h"
+#include "trace.h"
+
+// how many times each measurement is taken, the fastest one is reported
+static const int BENCH_REPEATS = 3;
+
+// times loading each trace (parse) and then simulating every config of a
+// fixed matrix over it (simulate), best of BENCH_REPEATS runs. one row per
+// measurement: trace,phase,config,accesses,seconds,accesses_per_second as
+// csv (the default) or one json object per line. input gives the reader
+// options, its path is replaced by each trace. false if a trace would not
+// open
+bool runBenchmark(const std::vector<std::string>& traces, const TraceOptions& input,
+                  const OutputOptions& output, std::ostream& out);
+
+#endif
@@ -0,0 +1,191 @@
+#include <cctype>
+#include <cstdlib>
+#include "cache.h"
+#include "classify.h"
+#include "prefetch.h"
+#include "sample.h"
+
+bool parsePowerOfTwo(const std::string& arg, int& value) {
+    // digits only, so no sign, spaces or trailing text get through strtoul
+    if (arg.empty() || !std::isdigit(static_cast<unsigned char>(arg[0]))) {
+        return false;
+    }
+    char* end;
+    unsigned long parsed = std::strtoul(arg.c_str(), &end, 10);
+    if (*end != '\0' || parsed == 0 || parsed > (1ul << 30) || (parsed & (parsed - 1)) != 0) {
+        return false;
+    }
+    value = int(parsed);
+    return true;
+}
+
+bool isPowerOfTwo(const std::string& arg) {
+    int value;
+    return parsePowerOfTwo(arg, value);
+}
+
+bool parseCacheConfig(const std::vector<std::string>& args, CacheConfig& config, std::ostream& err) {
+    if (args.size() != 6) {
+        err << "Incorect number of arguments. Should be: "<<
+                            "\n - number of sets in the cache (a positive power-of-2)"<<
+                            "\n - number of blocks in each set (a positive power-of-2)"<<
+                            "\n - number of bytes in each block (a positive power-of-2, at least 4)"<<
+                            "\n - write-allocate or no-write-allocate"<<
+                            "\n - write-through or write-back"<<
+                            "\n - lru (least-recently-used), fifo, random, plru (tree pseudo-lru),"<<
+                            "\n   srrip, brrip (re-reference interval prediction) or lfu evictions" << std::endl;
+        return false;
+    }
+
+    int sets, blocks, block_size;
+    if (!parsePowerOfTwo(args[0], sets)) {
+        err << "number of sets in cache must be a power of 2" << std::endl;
+        return false;
+    }
+
+    if (!parsePowerOfTwo(args[1], blocks)) {
+        err << "number of blocks in each set must a be power of 2" << std::endl;
+        return false;
+    }
+
+    if (!parsePowerOfTwo(args[2], block_size) || block_size < 4) {
+        err << "number of bytes in each block must be a positive power-of-2, at least 4" << std::endl;
+        return false;
+    }
+
+    if (args[3] != "write-allocate" && args[3] != "no-write-allocate") {
+        err << "cache miss parameter must be write-allocate or no-write-allocate" << std::endl;
+        return false;
+    }
+
+    if (args[4] != "write-through" && args[4] != "write-back") {
+        err << "store write parameter must be write-through or write-back" << std::endl;
+        return false;
+    }
+
+    if (!parsePolicy(args[5], config.policy)) {
+        err << "eviction parameter must be lru, fifo, random, plru, srrip, brrip or lfu" << std::endl;
+        return false;
+    }
+
+    config.num_sets = sets;
+    config.num_blocks = blocks;
+    config.block_size = block_size;
+    config.write_allocate = (args[3] == "write-allocate");
+    config.write_through = (args[4] == "write-through");
+
+    // Check for invalid combination
+    if (!config.write_allocate && !config.write_through) {
+        err << "no-write-allocate and write-back is an invalid combination" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::string formatCacheConfig(const CacheConfig& config) {
+    return std::to_string(config.num_sets) + " " + std::to_string(config.num_blocks) + " "
+        + std::to_string(config.block_size) + " "
+        + (config.write_allocate ? "write-allocate" : "no-write-allocate") + " "
+        + (config.write_through ? "write-through" : "write-back") + " "
+        + policyName(config.policy);
+}
+
+static const char* const POLICY_NAMES[] = {"lru", "fifo", "random", "plru", "srrip", "brrip", "lfu"};
+
+const char* policyName(ReplacementPolicy policy) {
+    return POLICY_NAMES[policy];
+}
+
+bool parsePolicy(const std::string& name, ReplacementPolicy& policy) {
+    for (size_t i = 0; i < sizeof(POLICY_NAMES) / sizeof(POLICY_NAMES[0]); i++) {
+        if (name == POLICY_NAMES[i]) {
+            policy = static_cast<ReplacementPolicy>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// makeCache() fans out over policy, then write policy, then associativity
+template <typename Policy, bool WriteAllocate, bool WriteThrough, typename Tag>
+static std::unique_ptr<Cache> makeWithWays(const CacheConfig& config, bool fixed_ways) {
+    if constexpr (sizeof(Tag) > sizeof(uint32_t)) {
+        // wide tags are rare enough not to be worth another 6 instantiations
+        // of every policy
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough, 0, Tag>(config));
+    }
+    switch (fixed_ways ? config.num_blocks : 0) {
+    case 1:
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough, 1>(config));
+    case 2:
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough, 2>(config));
+    case 4:
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough, 4>(config));
+    case 8:
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough, 8>(config));
+    case 16:
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough, 16>(config));
+    default:
+        return std::unique_ptr<Cache>(new CacheSimulator<Policy, WriteAllocate, WriteThrough>(config));
+    }
+}
+
+template <typename Policy, typename Tag>
+static std::unique_ptr<Cache> makeWithWritePolicy(const CacheConfig& config, bool fixed_ways) {
+    if (!config.write_allocate) {
+        return makeWithWays<Policy, false, true, Tag>(config, fixed_ways);
+    }
+    if (config.write_through) {
+        return makeWithWays<Policy, true, true, Tag>(config, fixed_ways);
+    }
+    return makeWithWays<Policy, true, false, Tag>(config, fixed_ways);
+}
+
+template <typename Tag>
+static std::unique_ptr<Cache> makeWithTag(const CacheConfig& config, bool fixed_ways) {
+    switch (config.policy) {
+    case POLICY_FIFO:
+        return makeWithWritePolicy<FifoPolicy, Tag>(config, fixed_ways);
+    case POLICY_RANDOM:
+        return makeWithWritePolicy<RandomPolicy, Tag>(config, fixed_ways);
+    case POLICY_PLRU:
+        return makeWithWritePolicy<TreePlruPolicy, Tag>(config, fixed_ways);
+    case POLICY_SRRIP:
+        return makeWithWritePolicy<SrripPolicy, Tag>(config, fixed_ways);
+    case POLICY_BRRIP:
+        return makeWithWritePolicy<BrripPolicy, Tag>(config, fixed_ways);
+    case POLICY_LFU:
+        return makeWithWritePolicy<LfuPolicy, Tag>(config, fixed_ways);
+    case POLICY_LRU:
+    default:
+        return makeWithWritePolicy<LruPolicy, Tag>(config, fixed_ways);
+    }
+}
+
+int tagBits(const CacheConfig& config) {
+    return config.address_bits - int(std::log2(config.num_sets)) - int(std::log2(config.block_size));
+}
+
+std::unique_ptr<Cache> makeCache(const CacheConfig& config, bool fixed_ways) {
+    if (config.sampling.enabled()) {
+        CacheConfig exact = config;
+        exact.sampling = SamplingConfig();
+        return std::unique_ptr<Cache>(new SampledCache(makeCache(exact, fixed_ways), config));
+    }
+    if (config.classify_misses) {
+        CacheConfig plain = config;
+        plain.classify_misses = false;
+        return std::unique_ptr<Cache>(new ClassifiedCache(makeCache(plain, fixed_ways), config));
+    }
+    if (config.prefetch.enabled()) {
+        CacheConfig plain = config;
+        plain.prefetch = PrefetchConfig();
+        return std::unique_ptr<Cache>(new PrefetchingCache(makeCache(plain, fixed_ways), config));
+    }
+    // the top bit of a tag is the valid bit
+    if (tagBits(config) > 31) {
+        return makeWithTag<uint64_t>(config, fixed_ways);
+    }
+    return makeWithTag<uint32_t>(config, fixed_ways);
+}
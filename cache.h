@@ -0,0 +1,853 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "access.h"
+#include "checkpoint.h"
+#include "policy.h"
+#include "tagmatch.h"
+#include "writebuffer.h"
+
+// cycle costs, the defaults are the original fixed model: 1 cycle per
+// access, 100 cycles per 4 byte word moved to or from memory
+struct LatencyModel {
+    unsigned int hit_cycles = 1;
+    // fixed cost of every memory transaction, on top of the transfer
+    unsigned int memory_latency = 0;
+    unsigned int word_cycles = 100;
+    // cost of writing a dirty block back, -1 to charge the same as a fill
+    long long writeback_cycles = -1;
+
+    uint64_t transferCycles(int bytes) const {
+        return memory_latency + uint64_t(word_cycles) * (bytes < 4 ? 1 : bytes / 4);
+    }
+    uint64_t missCycles(int block_size) const { return transferCycles(block_size); }
+    uint64_t writebackCycles(int block_size) const {
+        return writeback_cycles < 0 ? missCycles(block_size) : uint64_t(writeback_cycles);
+    }
+    // write-through stores move a single word
+    uint64_t storeThroughCycles() const { return transferCycles(4); }
+};
+
+// approximate runs over part of the trace, see SampledCache. set and time
+// sampling can be combined
+struct SamplingConfig {
+    // simulate one set in every set_ratio, picked by a hash of the set index
+    unsigned int set_ratio = 1;
+    // of every period accesses, warm the cache up on the first warmup and
+    // count the window after them, the rest are skipped. 0 for no time sampling
+    uint64_t period = 0;
+    uint64_t warmup = 0;
+    uint64_t window = 0;
+
+    bool enabled() const { return set_ratio > 1 || period > 0; }
+};
+
+// what fetches blocks ahead of the demand accesses, see PrefetchingCache
+enum PrefetchKind {
+    PREFETCH_NONE,
+    // the next blocks after every miss
+    PREFETCH_NEXT_LINE,
+    // along the strides a table of recent misses confirms, no pcs needed
+    PREFETCH_STREAM,
+    // next-line, again on the first hit to each prefetched block (smith)
+    PREFETCH_TAGGED
+};
+
+struct PrefetchConfig {
+    PrefetchKind kind = PREFETCH_NONE;
+    // blocks fetched ahead each time the prefetcher fires
+    unsigned int degree = 1;
+
+    bool enabled() const { return kind != PREFETCH_NONE; }
+};
+
+// one cache geometry and its policies, as given on the command line
+struct CacheConfig {
+    int num_sets;
+    int num_blocks;
+    int block_size;
+    bool write_allocate;
+    bool write_through;
+    ReplacementPolicy policy;
+    // not positional arguments, set from the command line options
+    LatencyModel latency;
+    // width of the trace addresses, more than 31 tag bits need 64 bit tags
+    int address_bits = 32;
+    // simulate an access that crosses a block boundary as one access per
+    // block it touches, instead of only the block of its first byte
+    bool split_accesses = false;
+    SamplingConfig sampling;
+    // sort the misses into compulsory, capacity and conflict, see
+    // ClassifiedCache
+    bool classify_misses = false;
+    PrefetchConfig prefetch;
+    // entries of the WriteBuffer write-through stores go into, 0 to send
+    // every store straight to memory. ignored for write-back
+    unsigned int write_buffer = 0;
+};
+
+// tag bits left once the set index and block offset are taken out
+int tagBits(const CacheConfig& config);
+
+// arg is a power of 2 from 1 to 2^30 and nothing else, no sign or trailing
+// text. value gets it when it is
+bool parsePowerOfTwo(const std::string& arg, int& value);
+bool isPowerOfTwo(const std::string& arg);
+
+// validates the six positional cache arguments, printing the reason to err
+// when they are rejected
+bool parseCacheConfig(const std::vector<std::string>& args, CacheConfig& config, std::ostream& err);
+
+// the positional arguments that would produce config
+std::string formatCacheConfig(const CacheConfig& config);
+
+// command line name of a replacement policy, and back
+const char* policyName(ReplacementPolicy policy);
+bool parsePolicy(const std::string& name, ReplacementPolicy& policy);
+
+// hit/miss counters, added together when a run is split up. 64 bits so
+// billion access traces do not overflow total_cycles
+struct CacheStats {
+    uint64_t total_loads;
+    uint64_t total_stores;
+    uint64_t load_hits;
+    uint64_t load_misses;
+    uint64_t store_hits;
+    uint64_t store_misses;
+    uint64_t total_cycles;
+    // trace records that crossed a block boundary, with split_accesses
+    uint64_t split_accesses;
+    // every address seen or-ed together, so a trace wider than the
+    // configured address bits can be spotted afterwards
+    Address address_mask;
+    // for sampled runs the counters above are estimates for the whole
+    // trace: the accesses actually counted, and the half width of the 95%
+    // confidence interval of the miss rate. both 0 for exact runs
+    uint64_t sampled_accesses;
+    double miss_rate_error;
+    // the misses by cause, with classify_misses
+    uint64_t compulsory_misses;
+    uint64_t capacity_misses;
+    uint64_t conflict_misses;
+    // with a prefetcher: the blocks it brought in, the ones a demand access
+    // then used, of those the ones still on their way from memory, and the
+    // ones replaced or invalidated unused. prefetch_cycles is the memory
+    // traffic they took, which overlaps the accesses and is not in
+    // total_cycles, the wait for a late one is
+    uint64_t prefetches;
+    uint64_t useful_prefetches;
+    uint64_t late_prefetches;
+    uint64_t useless_prefetches;
+    uint64_t prefetch_cycles;
+    // with a write buffer: the memory transactions of the write-through
+    // stores, the stores merged into one already waiting, and the cycles
+    // stores waited for a free entry, which are in total_cycles
+    uint64_t write_buffer_transactions;
+    uint64_t write_buffer_merges;
+    uint64_t write_buffer_stall_cycles;
+
+    CacheStats() : total_loads(0), total_stores(0), load_hits(0), load_misses(0),
+                   store_hits(0), store_misses(0), total_cycles(0), split_accesses(0), address_mask(0),
+                   sampled_accesses(0), miss_rate_error(0), compulsory_misses(0), capacity_misses(0),
+                   conflict_misses(0), prefetches(0), useful_prefetches(0), late_prefetches(0),
+                   useless_prefetches(0), prefetch_cycles(0), write_buffer_transactions(0),
+                   write_buffer_merges(0), write_buffer_stall_cycles(0) {}
+
+    CacheStats& operator+=(const CacheStats& other) {
+        total_loads += other.total_loads;
+        total_stores += other.total_stores;
+        load_hits += other.load_hits;
+        load_misses += other.load_misses;
+        store_hits += other.store_hits;
+        store_misses += other.store_misses;
+        total_cycles += other.total_cycles;
+        split_accesses += other.split_accesses;
+        address_mask |= other.address_mask;
+        sampled_accesses += other.sampled_accesses;
+        // intervals do not add up, keep the widest
+        miss_rate_error = std::max(miss_rate_error, other.miss_rate_error);
+        compulsory_misses += other.compulsory_misses;
+        capacity_misses += other.capacity_misses;
+        conflict_misses += other.conflict_misses;
+        prefetches += other.prefetches;
+        useful_prefetches += other.useful_prefetches;
+        late_prefetches += other.late_prefetches;
+        useless_prefetches += other.useless_prefetches;
+        prefetch_cycles += other.prefetch_cycles;
+        write_buffer_transactions += other.write_buffer_transactions;
+        write_buffer_merges += other.write_buffer_merges;
+        write_buffer_stall_cycles += other.write_buffer_stall_cycles;
+        return *this;
+    }
+
+    uint64_t accesses() const { return total_loads + total_stores; }
+    uint64_t misses() const { return load_misses + store_misses; }
+    double missRate() const { return accesses() ? double(misses()) / accesses() : 0; }
+
+    // average memory access time, hit time plus the miss rate times the
+    // penalty of a miss
+    double amat(const LatencyModel& latency, int block_size) const {
+        return latency.hit_cycles + missRate() * latency.missCycles(block_size);
+    }
+    // average cycles per access, everything the run actually paid
+    double acpa() const { return accesses() ? double(total_cycles) / accesses() : 0; }
+
+    void print(std::ostream& out) const {
+        out << "Total loads: " << total_loads << std::endl;
+        out << "Total stores: " << total_stores << std::endl;
+        out << "Load hits: " << load_hits << std::endl;
+        out << "Load misses: " << load_misses << std::endl;
+        out << "Store hits: " << store_hits << std::endl;
+        out << "Store misses: " << store_misses << std::endl;
+        out << "Total cycles: " << total_cycles << std::endl;
+        if (split_accesses) {
+            out << "Split accesses: " << split_accesses << std::endl;
+        }
+        if (sampled_accesses) {
+            out << "Sampled accesses: " << sampled_accesses << std::endl;
+            out << "Miss rate error (95% confidence): " << miss_rate_error << std::endl;
+        }
+        if (compulsory_misses + capacity_misses + conflict_misses) {
+            out << "Compulsory misses: " << compulsory_misses << std::endl;
+            out << "Capacity misses: " << capacity_misses << std::endl;
+            out << "Conflict misses: " << conflict_misses << std::endl;
+        }
+        if (prefetches) {
+            out << "Prefetches: " << prefetches << std::endl;
+            out << "Useful prefetches: " << useful_prefetches << std::endl;
+            out << "Late prefetches: " << late_prefetches << std::endl;
+            out << "Useless prefetches: " << useless_prefetches << std::endl;
+            out << "Prefetch traffic cycles: " << prefetch_cycles << std::endl;
+        }
+        if (write_buffer_transactions) {
+            out << "Write buffer transactions: " << write_buffer_transactions << std::endl;
+            out << "Write buffer merges: " << write_buffer_merges << std::endl;
+            out << "Write buffer stall cycles: " << write_buffer_stall_cycles << std::endl;
+        }
+    }
+};
+
+// one set's ways inside a BlockArena, structure of arrays so a whole set's
+// tags can be compared at once
+template <typename Tag>
+struct CacheSet {
+    // tag | validTag() for each way, 0 while the way is empty
+    Tag* tags;
+    unsigned char* dirty;
+    // ways are filled in order, so apart from invalidated ways the empty ones
+    // are always [*filled, blocks_per_set)
+    uint32_t* filled;
+};
+
+// every way of every set in one zeroed, cache line aligned allocation. set i
+// starts at way i * blocks_per_set in each array
+template <typename Tag>
+class BlockArena {
+private:
+    static const size_t LINE = 64;
+
+    size_t num_sets;
+    int blocks_per_set;
+    std::unique_ptr<void, void (*)(void*)> memory;
+    Tag* tags;
+    unsigned char* dirty;
+    uint32_t* filled;
+
+    static size_t roundUp(size_t bytes) { return (bytes + LINE - 1) & ~(LINE - 1); }
+
+public:
+    BlockArena(size_t sets, int blocks_per_set)
+        : num_sets(sets), blocks_per_set(blocks_per_set), memory(nullptr, std::free) {
+        size_t blocks = sets * blocks_per_set;
+        size_t tag_bytes = roundUp(blocks * sizeof(Tag));
+        size_t dirty_bytes = roundUp(blocks);
+        size_t filled_bytes = roundUp(sets * sizeof(uint32_t));
+        // calloc leaves large arenas as untouched zero pages until used
+        memory.reset(std::calloc(tag_bytes + dirty_bytes + filled_bytes + LINE, 1));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        uintptr_t base = roundUp(reinterpret_cast<uintptr_t>(memory.get()));
+        tags = reinterpret_cast<Tag*>(base);
+        dirty = reinterpret_cast<unsigned char*>(base + tag_bytes);
+        filled = reinterpret_cast<uint32_t*>(base + tag_bytes + dirty_bytes);
+    }
+
+    CacheSet<Tag> operator[](size_t set_index) const {
+        size_t first = set_index * blocks_per_set;
+        return CacheSet<Tag>{tags + first, dirty + first, filled + set_index};
+    }
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        size_t blocks = num_sets * blocks_per_set;
+        archive.bytes(tags, blocks * sizeof(Tag));
+        archive.bytes(dirty, blocks);
+        archive.bytes(filled, num_sets * sizeof(uint32_t));
+    }
+};
+
+// what a single access did, for callers that need more than the counters
+struct AccessResult {
+    bool hit;
+    // a miss that installed the block
+    bool filled;
+    // a valid block was replaced to make room, and whether it was dirty
+    bool evicted;
+    bool writeback;
+    // first byte of the replaced block
+    Address victim;
+};
+
+// calls visit(address) for every block the size bytes at address touch, the
+// first block with address itself and the others with their first byte, and
+// returns whether that was more than one. the split_accesses rule for the
+// modes that go through Cache::access()
+template <typename Visit>
+inline bool forEachBlock(Address address, int size, int block_bits, Visit visit) {
+    Address first = address >> block_bits;
+    Address last = (address + std::max(size, 1) - 1) >> block_bits;
+    visit(address);
+    for (Address block = first + 1; block <= last; block++) {
+        visit(block << block_bits);
+    }
+    return first != last;
+}
+
+// what the rest of csim drives, so the policy is picked once by makeCache()
+// and the access loops inside each CacheSimulator stay fully inlined
+class Cache {
+public:
+    virtual ~Cache() {}
+
+    virtual void processTrace(const Access* accesses, size_t count) = 0;
+    // processTrace with the set index and tag of a whole block of accesses
+    // decoded before any set is touched, the entry point for embedding
+    virtual void processBatch(const Access* accesses, size_t count) = 0;
+
+    // one access, counted like processTrace but reporting the outcome. one
+    // virtual call per access, so only for modes that need it
+    virtual AccessResult access(char operation, Address address) = 0;
+    // removes the block holding address, true if it was present
+    virtual bool invalidate(Address address, bool& dirty) = 0;
+    // marks the block holding address clean, true if it was dirty. whoever
+    // asks has the data written back, e.g. a coherence downgrade
+    virtual bool clean(Address address) = 0;
+    // marks the block holding address dirty without counting an access or
+    // touching its replacement state, true if it is present. a write-through
+    // cache keeps it clean, e.g. a modified block moving up from below
+    virtual bool markDirty(Address address) = 0;
+    // installs the block holding address without counting an access, e.g. a
+    // victim handed down from the level above
+    virtual AccessResult insert(Address address, bool dirty) = 0;
+    // fills the block holding address unless it is there already, without
+    // counting an access or touching the replacement state of a block that
+    // is. hit reports that it was
+    virtual AccessResult prefetch(Address address) = 0;
+
+    virtual int blockSize() const = 0;
+
+    // only simulate sets [first, first + count), for splitting one cache
+    // across threads. sets are independent so each shard replaces exactly as
+    // the whole cache would
+    virtual void setShard(unsigned int first, unsigned int count) = 0;
+    // processTrace for a shard, accesses to sets it does not own are skipped
+    virtual void processShardTrace(const Access* accesses, size_t count) = 0;
+
+    virtual const CacheStats& getStats() const = 0;
+    // zeroes the counters but keeps the contents, for leaving a warmup out
+    virtual void resetStats() = 0;
+
+    // the blocks, replacement state and counters, for carrying on later from
+    // exactly where this run stopped. false if out failed
+    virtual bool saveCheckpoint(std::ostream& out) = 0;
+    // restores what saveCheckpoint wrote from a cache of the same config,
+    // printing the reason to err and returning false when it does not fit
+    virtual bool loadCheckpoint(std::istream& in, std::ostream& err) = 0;
+
+    void printStats(std::ostream& out = std::cout) const {
+        getStats().print(out);
+    }
+};
+
+// fixed_ways picks a CacheSimulator with the associativity baked in when
+// there is one for config.num_blocks (1 to 16 ways). configs with more than
+// 31 tag bits get 64 bit tags, with the associativity left at runtime. with
+// config.sampling enabled the simulator is wrapped in a SampledCache, with
+// config.classify_misses in a ClassifiedCache and with config.prefetch in a
+// PrefetchingCache
+std::unique_ptr<Cache> makeCache(const CacheConfig& config, bool fixed_ways = true);
+
+// the write policies and, optionally, the associativity are template
+// parameters so the access loop has no policy branches and small sets unroll.
+// Ways is 0 for an associativity only known at runtime. Tag is uint32_t
+// unless the addresses leave more than 31 tag bits, which takes uint64_t
+template <typename Policy, bool WriteAllocate, bool WriteThrough, int Ways = 0, typename Tag = uint32_t>
+class CacheSimulator : public Cache {
+private:
+    // no-write-allocate only makes sense with write-through
+    static_assert(WriteAllocate || WriteThrough, "no-write-allocate requires write-through");
+
+    // accesses decoded at a time by processBatch, and how far ahead of the
+    // one being simulated it prefetches
+    static constexpr size_t DECODE_BATCH = 256;
+    static constexpr size_t PREFETCH_DISTANCE = 8;
+    static constexpr Tag VALID = validTag<Tag>();
+
+    int num_sets;
+    int num_blocks_per_set;
+    int block_size;
+    
+    BlockArena<Tag> sets;
+    Policy policy;
+    
+    // stats for the cache
+    CacheStats stats;
+
+    // the sets this simulator owns, all of them unless it is a shard
+    unsigned int first_set;
+    unsigned int shard_sets;
+    
+    int set_bits;
+    int block_bits;
+    int tag_bits;
+    // precomputed from the bits above for the access loop
+    unsigned int set_mask;
+    int tag_shift;
+    // from the latency model
+    uint64_t hit_cycles;
+    uint64_t miss_cycles;
+    uint64_t writeback_cycles;
+    uint64_t store_through_cycles;
+    // empty unless config.write_buffer is set for a write-through cache
+    WriteBuffer write_buffer;
+    // set once anything is invalidated, until then sets never have holes
+    bool holes;
+    bool split_accesses;
+
+    int ways() const { return Ways ? Ways : num_blocks_per_set; }
+    
+public:
+    CacheSimulator(int sets, int blocks_per_set, int bytes_per_block,
+                   const LatencyModel& latency = LatencyModel(), int address_bits = 32)
+        : num_sets(sets), num_blocks_per_set(blocks_per_set), block_size(bytes_per_block),
+          sets(sets, blocks_per_set), policy(sets, blocks_per_set),
+          first_set(0), shard_sets(sets), write_buffer(0, bytes_per_block, 0, 0), holes(false), split_accesses(false) {
+        
+        // bit possitioning
+        set_bits = std::log2(num_sets);
+        block_bits = std::log2(block_size);
+        tag_bits = address_bits - set_bits - block_bits;
+
+        set_mask = (1u << set_bits) - 1;
+        tag_shift = set_bits + block_bits;
+        hit_cycles = latency.hit_cycles;
+        miss_cycles = latency.missCycles(block_size);
+        writeback_cycles = latency.writebackCycles(block_size);
+        store_through_cycles = latency.storeThroughCycles();
+    }
+
+    explicit CacheSimulator(const CacheConfig& config)
+        : CacheSimulator(config.num_sets, config.num_blocks, config.block_size, config.latency,
+                         config.address_bits) {
+        split_accesses = config.split_accesses;
+        if (WriteThrough && config.write_buffer > 0) {
+            write_buffer = WriteBuffer(config.write_buffer, block_size, config.latency.memory_latency,
+                                       config.latency.word_cycles);
+        }
+    }
+
+    void setShard(unsigned int first, unsigned int count) override {
+        first_set = first;
+        shard_sets = count;
+        sets = BlockArena<Tag>(count, num_blocks_per_set);
+        policy = Policy(count, num_blocks_per_set);
+    }
+
+    void processAccess(char operation, Address address) {
+        unsigned int set_index = (address >> block_bits) & set_mask;
+        // block_bits is at least 2 so the tag never reaches VALID
+        Tag tag = Tag(address >> tag_shift) | VALID;
+        AccessResult unused;
+        stats.address_mask |= address;
+
+        if (operation == 'l') {
+            processLoad<false>(set_index - first_set, tag, unused);
+        } else {
+            processStore<false>(set_index - first_set, tag, address, unused);
+        }
+    }
+
+    void processShardAccess(char operation, Address address) {
+        unsigned int set_index = (address >> block_bits) & set_mask;
+        if (set_index - first_set >= shard_sets) {
+            return;
+        }
+        processAccess(operation, address);
+    }
+
+    void processTrace(const Access* accesses, size_t count) override {
+        processBatch(accesses, count);
+    }
+
+    void processBatch(const Access* accesses, size_t count) override {
+        if (split_accesses) {
+            processSplitTrace(accesses, count, false);
+            return;
+        }
+
+        unsigned int set_index[DECODE_BATCH];
+        Tag tags[DECODE_BATCH];
+        AccessResult unused;
+        Address mask = 0;
+
+        for (size_t base = 0; base < count; base += DECODE_BATCH) {
+            const Access* batch = accesses + base;
+            size_t n = std::min(count - base, DECODE_BATCH);
+            // no branches or stores to the sets, so this loop vectorizes
+            for (size_t i = 0; i < n; i++) {
+                set_index[i] = ((batch[i].address >> block_bits) & set_mask) - first_set;
+                tags[i] = Tag(batch[i].address >> tag_shift) | VALID;
+                mask |= batch[i].address;
+            }
+            // with the indices known, the tags of sets a few accesses ahead
+            // can be on their way in while this one is simulated
+            for (size_t i = 0; i < n; i++) {
+                if (i + PREFETCH_DISTANCE < n) {
+                    __builtin_prefetch(sets[set_index[i + PREFETCH_DISTANCE]].tags);
+                }
+                if (batch[i].operation == 'l') {
+                    processLoad<false>(set_index[i], tags[i], unused);
+                } else {
+                    processStore<false>(set_index[i], tags[i], batch[i].address, unused);
+                }
+            }
+        }
+        stats.address_mask |= mask;
+    }
+
+    void processShardTrace(const Access* accesses, size_t count) override {
+        if (split_accesses) {
+            processSplitTrace(accesses, count, true);
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            processShardAccess(accesses[i].operation, accesses[i].address);
+        }
+    }
+
+    // the split_accesses loop, kept apart so the usual one never looks at
+    // sizes. an access fitting in one block goes through as it is
+    void processSplitTrace(const Access* accesses, size_t count, bool shard) {
+        for (size_t i = 0; i < count; i++) {
+            Address first = accesses[i].address >> block_bits;
+            Address last = (accesses[i].address + std::max<int>(accesses[i].size, 1) - 1) >> block_bits;
+            // a shard only counts the accesses starting in its own sets
+            if (first != last && (!shard || ((first & set_mask) - first_set) < shard_sets)) {
+                stats.split_accesses++;
+            }
+            for (Address block = first; block <= last; block++) {
+                Address address = block == first ? accesses[i].address : block << block_bits;
+                if (shard) {
+                    processShardAccess(accesses[i].operation, address);
+                } else {
+                    processAccess(accesses[i].operation, address);
+                }
+            }
+        }
+    }
+
+    AccessResult access(char operation, Address address) override {
+        unsigned int set_index = (address >> block_bits) & set_mask;
+        Tag tag = Tag(address >> tag_shift) | VALID;
+        AccessResult result = AccessResult();
+        stats.address_mask |= address;
+
+        if (operation == 'l') {
+            processLoad<true>(set_index - first_set, tag, result);
+        } else {
+            processStore<true>(set_index - first_set, tag, address, result);
+        }
+        return result;
+    }
+
+    bool invalidate(Address address, bool& dirty) override {
+        unsigned int set_index = ((address >> block_bits) & set_mask) - first_set;
+        CacheSet<Tag> set = sets[set_index];
+        int way = findWay(set.tags, ways(), Tag(address >> tag_shift) | VALID);
+        if (way < 0) {
+            return false;
+        }
+        dirty = set.dirty[way];
+        set.tags[way] = 0;
+        set.dirty[way] = 0;
+        policy.onInvalidate(set_index, way);
+        holes = true;
+        return true;
+    }
+
+    bool clean(Address address) override {
+        CacheSet<Tag> set = sets[((address >> block_bits) & set_mask) - first_set];
+        int way = findWay(set.tags, ways(), Tag(address >> tag_shift) | VALID);
+        if (way < 0 || !set.dirty[way]) {
+            return false;
+        }
+        set.dirty[way] = 0;
+        return true;
+    }
+
+    bool markDirty(Address address) override {
+        CacheSet<Tag> set = sets[((address >> block_bits) & set_mask) - first_set];
+        int way = findWay(set.tags, ways(), Tag(address >> tag_shift) | VALID);
+        if (way < 0) {
+            return false;
+        }
+        if (!WriteThrough) {
+            set.dirty[way] = 1;
+        }
+        return true;
+    }
+
+    AccessResult insert(Address address, bool dirty) override {
+        unsigned int set_index = ((address >> block_bits) & set_mask) - first_set;
+        Tag tag = Tag(address >> tag_shift) | VALID;
+        CacheSet<Tag> set = sets[set_index];
+        AccessResult result = AccessResult();
+
+        int way = findWay(set.tags, ways(), tag);
+        if (way >= 0) {
+            result.hit = true;
+            policy.onHit(set_index, way);
+        } else {
+            result.filled = true;
+            way = allocateBlock<true>(set_index, set, tag, result);
+        }
+        if (dirty && !WriteThrough) {
+            set.dirty[way] = 1;
+        }
+        return result;
+    }
+
+    AccessResult prefetch(Address address) override {
+        unsigned int set_index = ((address >> block_bits) & set_mask) - first_set;
+        Tag tag = Tag(address >> tag_shift) | VALID;
+        CacheSet<Tag> set = sets[set_index];
+        AccessResult result = AccessResult();
+
+        if (findWay(set.tags, ways(), tag) >= 0) {
+            result.hit = true;
+        } else {
+            result.filled = true;
+            allocateBlock<true>(set_index, set, tag, result);
+        }
+        return result;
+    }
+
+    int blockSize() const override { return block_size; }
+    
+private:
+    // set_index is relative to first_set from here on. Report fills in out,
+    // it compiles away for the processTrace loop
+    template <bool Report>
+    void processLoad(unsigned int set_index, Tag tag, AccessResult& out) {
+        stats.total_loads++;
+        stats.total_cycles += hit_cycles;
+        CacheSet<Tag> set = sets[set_index];
+        
+        // if hit then increase the hit stat
+        int way = findWay(set.tags, ways(), tag);
+        if (way >= 0) {
+            stats.load_hits++;
+            policy.onHit(set_index, way);
+            if (Report) {
+                out.hit = true;
+            }
+            return;
+        }
+        // it was a miss
+        stats.load_misses++;
+        memoryTransfer(miss_cycles);
+        
+        allocateBlock<Report>(set_index, set, tag, out);
+        if (Report) {
+            out.filled = true;
+        }
+    }
+    
+    template <bool Report>
+    void processStore(unsigned int set_index, Tag tag, Address address, AccessResult& out) {
+        stats.total_stores++;
+        stats.total_cycles += hit_cycles;
+        CacheSet<Tag> set = sets[set_index];
+        
+        int way = findWay(set.tags, ways(), tag);
+        if (way >= 0) {
+            stats.store_hits++;
+            policy.onHit(set_index, way);
+            if (!WriteThrough) {
+                set.dirty[way] = 1;
+            } else {
+                storeThrough(address);
+            }
+            if (Report) {
+                out.hit = true;
+            }
+            return;
+        }
+        stats.store_misses++;
+        
+        if (WriteAllocate) {
+            memoryTransfer(miss_cycles);
+            way = allocateBlock<Report>(set_index, set, tag, out);
+            if (!WriteThrough) {
+                set.dirty[way] = 1;
+            } else {
+                storeThrough(address);
+            }
+            if (Report) {
+                out.filled = true;
+            }
+        } else {
+            storeThrough(address);
+        }
+    }
+
+    // a fill or writeback the access waits for, which also waits for a
+    // write buffer drain that already has the memory
+    void memoryTransfer(uint64_t cycles) {
+        if (WriteThrough && write_buffer.enabled()) {
+            uint64_t wait = write_buffer.transfer(stats.total_cycles, cycles);
+            stats.total_cycles += wait;
+            stats.write_buffer_stall_cycles += wait;
+        }
+        stats.total_cycles += cycles;
+    }
+
+    // the word a write-through store sends to memory
+    void storeThrough(Address address) {
+        if (!write_buffer.enabled()) {
+            stats.total_cycles += store_through_cycles;
+            return;
+        }
+        WriteBuffer::Result result = write_buffer.store(address, stats.total_cycles);
+        if (result.merged) {
+            stats.write_buffer_merges++;
+        } else {
+            stats.write_buffer_transactions++;
+        }
+        stats.total_cycles += result.wait;
+        stats.write_buffer_stall_cycles += result.wait;
+    }
+    
+    // installs tag and returns the way it went into
+    template <bool Report>
+    int allocateBlock(unsigned int set_index, const CacheSet<Tag>& set, Tag tag, AccessResult& out) {
+        int way;
+        if (*set.filled < uint32_t(ways())) {
+            way = (*set.filled)++;
+        } else if (!holes || (way = findWay(set.tags, ways(), 0)) < 0) {
+            way = evictBlock<Report>(set_index, set, out);
+        }
+        set.tags[way] = tag;
+        set.dirty[way] = 0;
+        policy.onFill(set_index, way);
+        return way;
+    }
+    // make room for a new block, the victim way is reused for it
+    template <bool Report>
+    int evictBlock(unsigned int set_index, const CacheSet<Tag>& set, AccessResult& out) {
+        int evict_index = policy.victim(set_index);
+    
+        if (!WriteThrough && set.dirty[evict_index]) {
+            memoryTransfer(writeback_cycles); // Writeback to memory
+            if (Report) {
+                out.writeback = true;
+            }
+        }
+        if (Report) {
+            out.evicted = true;
+            out.victim = (Address(set.tags[evict_index] & ~VALID) << tag_shift)
+                | (Address(set_index + first_set) << block_bits);
+        }
+        return evict_index;
+    }
+    
+public:
+    const CacheStats& getStats() const override { return stats; }
+
+    void resetStats() override {
+        // the address width check still covers the warmup
+        Address mask = stats.address_mask;
+        write_buffer.restartClock(stats.total_cycles);
+        stats = CacheStats();
+        stats.address_mask = mask;
+    }
+
+    bool saveCheckpoint(std::ostream& out) override {
+        CheckpointWriter writer(out);
+        writer.bytes(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        writer(checkpointHeader());
+        writer(stats);
+        writer(holes);
+        sets.checkpoint(writer);
+        policy.checkpoint(writer);
+        write_buffer.checkpoint(writer);
+        return writer.ok();
+    }
+
+    bool loadCheckpoint(std::istream& in, std::ostream& err) override {
+        CheckpointReader reader(in);
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        reader.bytes(magic, sizeof(magic));
+        if (!reader.ok() || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+            err << "not a csim checkpoint" << std::endl;
+            return false;
+        }
+        CheckpointHeader header;
+        CheckpointHeader expected = checkpointHeader();
+        reader(header);
+        if (!reader.ok() || std::memcmp(&header, &expected, sizeof(header)) != 0) {
+            err << "the checkpoint is of a different cache configuration" << std::endl;
+            return false;
+        }
+        reader(stats);
+        reader(holes);
+        sets.checkpoint(reader);
+        policy.checkpoint(reader);
+        write_buffer.checkpoint(reader);
+        if (!reader.ok()) {
+            err << "the checkpoint is truncated" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    CheckpointHeader checkpointHeader() const {
+        CheckpointHeader header;
+        header.version = CHECKPOINT_VERSION;
+        header.sets = num_sets;
+        header.blocks_per_set = num_blocks_per_set;
+        header.block_size = block_size;
+        header.first_set = first_set;
+        header.shard_sets = shard_sets;
+        header.tag_bytes = sizeof(Tag);
+        header.policy = Policy::KIND;
+        header.write_allocate = WriteAllocate;
+        header.write_through = WriteThrough;
+        header.write_buffer = write_buffer.capacity();
+        return header;
+    }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+// the raw simulator state behind Cache::saveCheckpoint and loadCheckpoint.
+// the parts are written in a fixed order with no framing. each part that has
+// state lists it in a checkpoint(archive) member template, and both archives
+// below can be passed to it, so one list covers saving and loading
+
+static const char CHECKPOINT_MAGIC[8] = {'C', 'S', 'I', 'M', 'C', 'K', 'P', 'T'};
+static const uint32_t CHECKPOINT_VERSION = 2;
+
+// what the state was saved from, a checkpoint only loads into the same
+struct CheckpointHeader {
+    uint32_t version;
+    uint32_t sets;
+    uint32_t blocks_per_set;
+    uint32_t block_size;
+    uint32_t first_set;
+    uint32_t shard_sets;
+    uint32_t tag_bytes;
+    uint32_t policy;
+    uint32_t write_allocate;
+    uint32_t write_through;
+    uint32_t write_buffer;
+};
+
+class CheckpointWriter {
+private:
+    std::ostream& out;
+
+public:
+    explicit CheckpointWriter(std::ostream& out) : out(out) {}
+
+    void bytes(const void* data, size_t size) { out.write(static_cast<const char*>(data), size); }
+
+    template <typename T>
+    void operator()(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values are written raw");
+        bytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void operator()(const std::vector<T>& values) {
+        uint64_t count = values.size();
+        (*this)(count);
+        bytes(values.data(), count * sizeof(T));
+    }
+
+    bool ok() const { return bool(out); }
+};
+
+class CheckpointReader {
+private:
+    std::istream& in;
+    bool failed;
+
+public:
+    explicit CheckpointReader(std::istream& in) : in(in), failed(false) {}
+
+    void bytes(void* data, size_t size) {
+        if (!failed && !in.read(static_cast<char*>(data), size)) {
+            failed = true;
+        }
+    }
+
+    template <typename T>
+    void operator()(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values are read raw");
+        bytes(&value, sizeof(T));
+    }
+
+    // values already has the size the geometry gives it, anything else
+    // stored means the checkpoint does not fit
+    template <typename T>
+    void operator()(std::vector<T>& values) {
+        uint64_t count = 0;
+        (*this)(count);
+        if (count != values.size()) {
+            failed = true;
+            return;
+        }
+        bytes(values.data(), count * sizeof(T));
+    }
+
+    // false once anything was short or the wrong size
+    bool ok() const { return !failed; }
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "classify.h"
+
+BlockTable::BlockTable(size_t expected) : count(0), shift(64) {
+    size_t slots = 16;
+    while (slots < 2 * expected) {
+        slots *= 2;
+    }
+    keys.assign(slots, 0);
+    values.assign(slots, 0);
+    for (size_t s = slots; s > 1; s >>= 1) {
+        shift--;
+    }
+}
+
+void BlockTable::grow() {
+    std::vector<uint64_t> old_keys;
+    std::vector<uint32_t> old_values;
+    old_keys.swap(keys);
+    old_values.swap(values);
+    keys.assign(old_keys.size() * 2, 0);
+    values.assign(old_values.size() * 2, 0);
+    shift--;
+    count = 0;
+    for (size_t i = 0; i < old_keys.size(); i++) {
+        if (old_keys[i]) {
+            insert(old_keys[i] - 1, old_values[i]);
+        }
+    }
+}
+
+uint32_t* BlockTable::find(uint64_t block) {
+    uint64_t key = block + 1;
+    size_t mask = keys.size() - 1;
+    for (size_t i = slot(key); keys[i]; i = (i + 1) & mask) {
+        if (keys[i] == key) {
+            return &values[i];
+        }
+    }
+    return nullptr;
+}
+
+bool BlockTable::insert(uint64_t block, uint32_t value) {
+    // at most half full keeps the probes short
+    if (2 * (count + 1) > keys.size()) {
+        grow();
+    }
+    uint64_t key = block + 1;
+    size_t mask = keys.size() - 1;
+    size_t i = slot(key);
+    for (; keys[i]; i = (i + 1) & mask) {
+        if (keys[i] == key) {
+            return false;
+        }
+    }
+    keys[i] = key;
+    values[i] = value;
+    count++;
+    return true;
+}
+
+void BlockTable::erase(uint64_t block) {
+    uint64_t key = block + 1;
+    size_t mask = keys.size() - 1;
+    size_t i = slot(key);
+    while (keys[i] != key) {
+        if (!keys[i]) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    // pull back every later entry of the run that may sit in the hole
+    for (size_t j = (i + 1) & mask; keys[j]; j = (j + 1) & mask) {
+        size_t home = slot(keys[j]);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            keys[i] = keys[j];
+            values[i] = values[j];
+            i = j;
+        }
+    }
+    keys[i] = 0;
+    count--;
+}
+
+MissClassifier::MissClassifier(uint32_t max_blocks)
+    : max_blocks(max_blocks), blocks(max_blocks, 0), prev(max_blocks, 0), next(max_blocks, 0), head(0),
+      tail(0), size(0), resident(max_blocks), compulsory_misses(0), capacity_misses(0), conflict_misses(0) {}
+
+void MissClassifier::unlink(uint32_t node) {
+    if (prev[node]) {
+        next[prev[node] - 1] = next[node];
+    } else {
+        head = next[node];
+    }
+    if (next[node]) {
+        prev[next[node] - 1] = prev[node];
+    } else {
+        tail = prev[node];
+    }
+}
+
+void MissClassifier::pushFront(uint32_t node) {
+    prev[node] = 0;
+    next[node] = head;
+    if (head) {
+        prev[head - 1] = node + 1;
+    } else {
+        tail = node + 1;
+    }
+    head = node + 1;
+}
+
+bool MissClassifier::shadowAccess(uint64_t block, bool allocate) {
+    uint32_t* node = resident.find(block);
+    if (node) {
+        if (head != *node + 1) {
+            unlink(*node);
+            pushFront(*node);
+        }
+        return true;
+    }
+    if (!allocate) {
+        return false;
+    }
+
+    uint32_t fill;
+    if (size < max_blocks) {
+        fill = size++;
+    } else {
+        fill = tail - 1;
+        unlink(fill);
+        resident.erase(blocks[fill]);
+    }
+    blocks[fill] = block;
+    resident.insert(block, fill);
+    pushFront(fill);
+    return false;
+}
+
+void MissClassifier::access(uint64_t block, bool hit, bool allocate) {
+    bool shadow_hit = shadowAccess(block, allocate);
+    // a block still in the shadow cache has been touched before
+    bool first_touch = !shadow_hit && touched.insert(block, 0);
+    if (hit) {
+        return;
+    }
+    if (first_touch) {
+        compulsory_misses++;
+    } else if (shadow_hit) {
+        conflict_misses++;
+    } else {
+        capacity_misses++;
+    }
+}
+
+ClassifiedCache::ClassifiedCache(std::unique_ptr<Cache> cache, const CacheConfig& config)
+    : cache(std::move(cache)), classifier(uint32_t(config.num_sets) * config.num_blocks),
+      block_bits(std::log2(config.block_size)), write_allocate(config.write_allocate),
+      split_accesses(config.split_accesses), split_records(0) {}
+
+AccessResult ClassifiedCache::access(char operation, Address address) {
+    AccessResult result = cache->access(operation, address);
+    classifier.access(address >> block_bits, result.hit, operation == 'l' || write_allocate);
+    return result;
+}
+
+void ClassifiedCache::processBatch(const Access* accesses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char operation = accesses[i].operation;
+        if (!split_accesses) {
+            access(operation, accesses[i].address);
+        } else if (forEachBlock(accesses[i].address, accesses[i].size, block_bits,
+                                [&](Address address) { access(operation, address); })) {
+            split_records++;
+        }
+    }
+}
+
+const CacheStats& ClassifiedCache::getStats() const {
+    stats = cache->getStats();
+    stats.split_accesses += split_records;
+    stats.compulsory_misses = classifier.compulsory_misses;
+    stats.capacity_misses = classifier.capacity_misses;
+    stats.conflict_misses = classifier.conflict_misses;
+    return stats;
+}
+
+void ClassifiedCache::resetStats() {
+    cache->resetStats();
+    split_records = 0;
+    classifier.compulsory_misses = 0;
+    classifier.capacity_misses = 0;
+    classifier.conflict_misses = 0;
+}
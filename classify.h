@@ -0,0 +1,114 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cache.h"
+
+// open addressing hash table from block number to a uint32_t, linear probing
+// with backward shift deletion so there are no tombstones. grows as needed
+class BlockTable {
+private:
+    // block + 1 in each slot, 0 while it is empty
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> values;
+    size_t count;
+    int shift;
+
+    size_t slot(uint64_t key) const { return (key * 0x9e3779b97f4a7c15ull) >> shift; }
+    void grow();
+
+public:
+    explicit BlockTable(size_t expected = 1024);
+
+    // the value of block, or nullptr if it is not in the table
+    uint32_t* find(uint64_t block);
+    // adds block with value unless it is there already, true if it was added
+    bool insert(uint64_t block, uint32_t value);
+    void erase(uint64_t block);
+};
+
+// sorts the misses of a cache into the 3 Cs (hill): compulsory on the first
+// touch of a block, conflict if a fully associative LRU cache of the same
+// capacity would have hit, capacity otherwise. the fully associative cache
+// is a hash table over an intrusive recency list, constant time per access
+class MissClassifier {
+private:
+    uint32_t max_blocks;
+    // shadow cache, node i holds blocks[i], linked most recent first with
+    // node + 1 indices and 0 for none
+    std::vector<uint64_t> blocks;
+    std::vector<uint32_t> prev;
+    std::vector<uint32_t> next;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t size;
+    BlockTable resident;
+    // every block ever touched
+    BlockTable touched;
+
+    void unlink(uint32_t node);
+    void pushFront(uint32_t node);
+    // accesses block in the shadow cache, true on a hit. a miss only
+    // installs it if allocate is set
+    bool shadowAccess(uint64_t block, bool allocate);
+
+public:
+    uint64_t compulsory_misses;
+    uint64_t capacity_misses;
+    uint64_t conflict_misses;
+
+    explicit MissClassifier(uint32_t blocks);
+
+    // every access goes through, whether or not the real cache hit
+    void access(uint64_t block, bool hit, bool allocate);
+};
+
+// a cache whose misses are classified with a MissClassifier, the counts come
+// back in the compulsory, capacity and conflict fields of getStats(). one
+// virtual access() call per access, so only when asked for. access() itself
+// is classified too, so other wrappers can go through it
+class ClassifiedCache : public Cache {
+private:
+    std::unique_ptr<Cache> cache;
+    MissClassifier classifier;
+    int block_bits;
+    bool write_allocate;
+    bool split_accesses;
+    uint64_t split_records;
+    mutable CacheStats stats;
+
+public:
+    // cache must be unclassified, it does the simulating
+    ClassifiedCache(std::unique_ptr<Cache> cache, const CacheConfig& config);
+
+    void processTrace(const Access* accesses, size_t count) override { processBatch(accesses, count); }
+    void processBatch(const Access* accesses, size_t count) override;
+
+    AccessResult access(char operation, Address address) override;
+
+    // the rest go straight to the wrapped cache, unclassified
+    bool invalidate(Address address, bool& dirty) override { return cache->invalidate(address, dirty); }
+    bool clean(Address address) override { return cache->clean(address); }
+    bool markDirty(Address address) override { return cache->markDirty(address); }
+    AccessResult insert(Address address, bool dirty) override { return cache->insert(address, dirty); }
+    AccessResult prefetch(Address address) override { return cache->prefetch(address); }
+    int blockSize() const override { return cache->blockSize(); }
+    void setShard(unsigned int first, unsigned int count) override { cache->setShard(first, count); }
+    void processShardTrace(const Access* accesses, size_t count) override {
+        cache->processShardTrace(accesses, count);
+    }
+
+    const CacheStats& getStats() const override;
+    void resetStats() override;
+
+    // the shadow cache would have to go with it
+    bool saveCheckpoint(std::ostream&) override { return false; }
+    bool loadCheckpoint(std::istream&, std::ostream& err) override {
+        err << "classified runs cannot be checkpointed" << std::endl;
+        return false;
+    }
+};
+
+#endif
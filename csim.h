@@ -0,0 +1,28 @@
+#ifndef CSIM_H
+#define CSIM_H
+
+// everything libcsim.a provides, for tools that embed the simulator:
+//
+//   CacheConfig config;
+//   parseCacheConfig({"256", "4", "16", "write-allocate", "write-back", "lru"}, config, std::cerr);
+//   std::unique_ptr<Cache> cache = makeCache(config);
+//   cache->processBatch(accesses, count);
+//   printReport(config, cache->getStats(), OutputOptions(), false, std::cout);
+
+#include "bench.h"
+#include "cache.h"
+#include "classify.h"
+#include "hierarchy.h"
+#include "interval.h"
+#include "multicore.h"
+#include "outcome.h"
+#include "parallel.h"
+#include "prefetch.h"
+#include "profile.h"
+#include "report.h"
+#include "sample.h"
+#include "server.h"
+#include "sweep.h"
+#include "trace.h"
+
+#endif
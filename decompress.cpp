@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include "decompress.h"
+
+#ifdef CSIM_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSIM_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CSIM_XZ
+#include <lzma.h>
+#endif
+
+static const size_t READ_SIZE = 1 << 18;
+
+Compression detectCompression(const char* data, size_t size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        return COMPRESSION_GZIP;
+    }
+    if (size >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+        return COMPRESSION_ZSTD;
+    }
+    if (size >= 6 && std::memcmp(p, "\xfd" "7zXZ\0", 6) == 0) {
+        return COMPRESSION_XZ;
+    }
+    return COMPRESSION_NONE;
+}
+
+Decompressor::Decompressor(Compression kind, const char* data, size_t size, int fd)
+    : kind(kind), input(data), input_size(size), fd(fd), current(nullptr), offset(0), finished(false),
+      error(false), stopping(false) {
+    worker = std::thread(&Decompressor::run, this);
+}
+
+Decompressor::~Decompressor() {
+    stopping = true;
+    worker.join();
+}
+
+bool Decompressor::nextInput(const unsigned char*& data, size_t& size) {
+    if (input_size > 0) {
+        data = reinterpret_cast<const unsigned char*>(input);
+        size = input_size;
+        input_size = 0;
+        return true;
+    }
+    if (fd < 0) {
+        return false;
+    }
+    read_buffer.resize(READ_SIZE);
+    ssize_t n;
+    do {
+        n = ::read(fd, read_buffer.data(), read_buffer.size());
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        fd = -1;
+        return false;
+    }
+    data = reinterpret_cast<const unsigned char*>(read_buffer.data());
+    size = n;
+    return true;
+}
+
+Decompressor::Chunk* Decompressor::beginChunk() {
+    Chunk* chunk;
+    while (!(chunk = ring.tryWriteSlot())) {
+        if (stopping) {
+            return nullptr;
+        }
+        std::this_thread::yield();
+    }
+    chunk->size = 0;
+    return chunk;
+}
+
+void Decompressor::run() {
+    Chunk* out = beginChunk();
+    if (!out) {
+        return;
+    }
+
+    bool ok = false;
+    if (kind == COMPRESSION_GZIP) {
+        ok = runGzip(out);
+    } else if (kind == COMPRESSION_ZSTD) {
+        ok = runZstd(out);
+    } else if (kind == COMPRESSION_XZ) {
+        ok = runXz(out);
+    }
+    if (!out) {
+        return;
+    }
+    if (!ok) {
+        error = true;
+        std::cerr << "could not decompress the trace" << std::endl;
+    }
+
+    if (out->size > 0) {
+        ring.push();
+        if (!(out = beginChunk())) {
+            return;
+        }
+    }
+    ring.push();
+}
+
+size_t Decompressor::read(char* out, size_t size) {
+    size_t copied = 0;
+    while (copied < size && !finished) {
+        if (!current) {
+            // only wait when there is nothing at all to hand back yet
+            current = copied ? ring.tryReadSlot() : ring.readSlot();
+            if (!current) {
+                break;
+            }
+            offset = 0;
+            if (current->size == 0) {
+                finished = true;
+                current = nullptr;
+                break;
+            }
+        }
+        size_t n = std::min(size - copied, current->size - offset);
+        std::memcpy(out + copied, current->data + offset, n);
+        copied += n;
+        offset += n;
+        if (offset == current->size) {
+            ring.pop();
+            current = nullptr;
+        }
+    }
+    return copied;
+}
+
+// each run* decompresses the whole input into chunks starting with out,
+// pushing every full one. false on corrupt or truncated input, or a format
+// csim was built without, out is nullptr if the destructor stopped it
+
+bool Decompressor::runGzip(Chunk*& out) {
+#ifdef CSIM_ZLIB
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    // 32 accepts both gzip and zlib headers
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+        return false;
+    }
+
+    const unsigned char* data;
+    size_t size;
+    bool in_member = false;
+    bool ok = true;
+    while (nextInput(data, size)) {
+        zs.next_in = const_cast<unsigned char*>(data);
+        zs.avail_in = size;
+        // inflate may consume the last of the input and still hold output
+        // back when out fills up, so go round again until it has room left
+        bool full = false;
+        while (zs.avail_in > 0 || full) {
+            zs.next_out = reinterpret_cast<unsigned char*>(out->data + out->size);
+            zs.avail_out = CHUNK_SIZE - out->size;
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            out->size = CHUNK_SIZE - zs.avail_out;
+            in_member = in_member || ret != Z_BUF_ERROR;
+            full = out->size == CHUNK_SIZE;
+            if (full) {
+                ring.push();
+                if (!(out = beginChunk())) {
+                    inflateEnd(&zs);
+                    return false;
+                }
+            }
+            if (ret == Z_STREAM_END) {
+                // gzip files may be several members back to back
+                inflateReset(&zs);
+                in_member = false;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    inflateEnd(&zs);
+    return ok && !in_member;
+#else
+    (void)out;
+    std::cerr << "the trace is gzip compressed, build csim with ZLIB=1 to read it" << std::endl;
+    return false;
+#endif
+}
+
+bool Decompressor::runZstd(Chunk*& out) {
+#ifdef CSIM_ZSTD
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        return false;
+    }
+
+    const unsigned char* data;
+    size_t size;
+    // non-zero while a frame is unfinished
+    size_t pending = 0;
+    bool ok = true;
+    while (ok && nextInput(data, size)) {
+        ZSTD_inBuffer in = {data, size, 0};
+        while (in.pos < in.size) {
+            ZSTD_outBuffer buf = {out->data, CHUNK_SIZE, out->size};
+            pending = ZSTD_decompressStream(dctx, &buf, &in);
+            out->size = buf.pos;
+            if (ZSTD_isError(pending)) {
+                ok = false;
+                break;
+            }
+            if (out->size == CHUNK_SIZE) {
+                ring.push();
+                if (!(out = beginChunk())) {
+                    ZSTD_freeDCtx(dctx);
+                    return false;
+                }
+            }
+        }
+    }
+    // flush what the last frame still holds
+    while (ok && pending > 0) {
+        ZSTD_inBuffer in = {nullptr, 0, 0};
+        ZSTD_outBuffer buf = {out->data, CHUNK_SIZE, out->size};
+        size_t before = buf.pos;
+        pending = ZSTD_decompressStream(dctx, &buf, &in);
+        out->size = buf.pos;
+        if (ZSTD_isError(pending) || (pending > 0 && buf.pos == before && buf.pos < CHUNK_SIZE)) {
+            // truncated frame
+            ok = false;
+            break;
+        }
+        if (out->size == CHUNK_SIZE) {
+            ring.push();
+            if (!(out = beginChunk())) {
+                ZSTD_freeDCtx(dctx);
+                return false;
+            }
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+    return ok;
+#else
+    (void)out;
+    std::cerr << "the trace is zstd compressed, build csim with ZSTD=1 to read it" << std::endl;
+    return false;
+#endif
+}
+
+bool Decompressor::runXz(Chunk*& out) {
+#ifdef CSIM_XZ
+    lzma_stream xz = LZMA_STREAM_INIT;
+    // concatenated .xz streams decode as one
+    if (lzma_stream_decoder(&xz, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        return false;
+    }
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    lzma_action action = LZMA_RUN;
+    lzma_ret ret = LZMA_OK;
+    for (;;) {
+        if (xz.avail_in == 0 && action == LZMA_RUN) {
+            if (nextInput(data, size)) {
+                xz.next_in = data;
+                xz.avail_in = size;
+            } else {
+                action = LZMA_FINISH;
+            }
+        }
+        xz.next_out = reinterpret_cast<uint8_t*>(out->data + out->size);
+        xz.avail_out = CHUNK_SIZE - out->size;
+        ret = lzma_code(&xz, action);
+        out->size = CHUNK_SIZE - xz.avail_out;
+        if (out->size == CHUNK_SIZE) {
+            ring.push();
+            if (!(out = beginChunk())) {
+                lzma_end(&xz);
+                return false;
+            }
+        }
+        if (ret != LZMA_OK) {
+            break;
+        }
+    }
+    lzma_end(&xz);
+    return ret == LZMA_STREAM_END;
+#else
+    (void)out;
+    std::cerr << "the trace is xz compressed, build csim with XZ=1 to read it" << std::endl;
+    return false;
+#endif
+}
@@ -0,0 +1,79 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include "ring.h"
+
+// compressed trace formats, recognised by their magic number. each library
+// is optional, see CSIM_ZLIB, CSIM_ZSTD and CSIM_XZ in the Makefile
+enum Compression {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD,
+    COMPRESSION_XZ
+};
+
+// the format data starts with, size may be short of a whole magic number
+Compression detectCompression(const char* data, size_t size);
+
+// decompresses on its own thread, handing chunks of output to read() through
+// a SpscRing so the parser never waits on the decompressor unless it is
+// actually behind. input is data, then whatever is left to read() from fd
+// (-1 for nothing), data must outlive the Decompressor
+class Decompressor {
+private:
+    static const size_t CHUNK_SIZE = 1 << 18;
+    static const size_t RING_DEPTH = 8;
+
+    struct Chunk {
+        char data[CHUNK_SIZE];
+        // a chunk of 0 bytes ends the output
+        size_t size;
+    };
+
+    Compression kind;
+    const char* input;
+    size_t input_size;
+    int fd;
+    std::vector<char> read_buffer;
+
+    SpscRing<Chunk, RING_DEPTH> ring;
+    // consumer side, the chunk being read and how far into it
+    Chunk* current;
+    size_t offset;
+    bool finished;
+    // set by the worker before it pushes the last chunk, so read() sees it
+    // by the time it returns 0
+    bool error;
+
+    // set by the destructor to stop a worker waiting on a full ring
+    std::atomic<bool> stopping;
+    std::thread worker;
+
+    // the next piece of compressed input, false at the end of it
+    bool nextInput(const unsigned char*& data, size_t& size);
+    // an empty chunk to decompress into, nullptr once stopping
+    Chunk* beginChunk();
+    void run();
+    bool runGzip(Chunk*& out);
+    bool runZstd(Chunk*& out);
+    bool runXz(Chunk*& out);
+
+public:
+    Decompressor(Compression kind, const char* data, size_t size, int fd);
+    ~Decompressor();
+
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    // copies up to size decompressed bytes out, waiting only when nothing is
+    // ready. 0 at the end of the output or after an error
+    size_t read(char* out, size_t size);
+    // once read() has returned 0, whether the input could not be decompressed
+    bool failed() const { return error; }
+};
+
+#endif
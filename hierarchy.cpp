@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "hierarchy.h"
+
+bool readHierarchyFile(const std::string& path, std::vector<LevelConfig>& levels, std::ostream& err) {
+    std::ifstream in(path);
+    if (!in) {
+        err << "could not open hierarchy file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        std::istringstream words(line);
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word) {
+            args.push_back(word);
+        }
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+
+        LevelConfig level;
+        level.inclusion = INCLUSION_NINE;
+        level.hit_latency = 1;
+        // optional trailing inclusion policy and hit latency
+        while (args.size() > 6) {
+            const std::string& extra = args.back();
+            if (extra == "nine") {
+                level.inclusion = INCLUSION_NINE;
+            } else if (extra == "inclusive") {
+                level.inclusion = INCLUSION_INCLUSIVE;
+            } else if (extra == "exclusive") {
+                level.inclusion = INCLUSION_EXCLUSIVE;
+            } else if (extra.find_first_not_of("0123456789") == std::string::npos) {
+                level.hit_latency = std::atoi(extra.c_str());
+            } else {
+                err << path << ":" << line_number << ": expected inclusive, exclusive, nine or a hit latency, got "
+                    << extra << std::endl;
+                return false;
+            }
+            args.pop_back();
+        }
+
+        if (!parseCacheConfig(args, level.cache, err)) {
+            err << path << ":" << line_number << ": invalid cache configuration" << std::endl;
+            return false;
+        }
+        // blocks move whole between an exclusive level and the one above it
+        if (level.inclusion == INCLUSION_EXCLUSIVE && !levels.empty()
+            && levels.back().cache.block_size != level.cache.block_size) {
+            err << path << ":" << line_number << ": an exclusive level must use the block size of the level above"
+                << std::endl;
+            return false;
+        }
+        // the dirty victims it takes in have to stay dirty until they leave
+        if (level.inclusion == INCLUSION_EXCLUSIVE && level.cache.write_through) {
+            err << path << ":" << line_number << ": an exclusive level must be write-back" << std::endl;
+            return false;
+        }
+        levels.push_back(level);
+    }
+
+    if (levels.empty()) {
+        err << path << ": no cache levels" << std::endl;
+        return false;
+    }
+    levels[0].inclusion = INCLUSION_NINE;
+    return true;
+}
+
+CacheHierarchy::CacheHierarchy(const std::vector<LevelConfig>& configs, const LatencyModel& latency)
+    : configs(configs), stats(configs.size(), LevelStats()), latency(latency),
+      memory_reads(0), memory_writes(0), total_cycles(0) {
+    for (const LevelConfig& config : configs) {
+        levels.push_back(makeCache(config.cache));
+    }
+}
+
+void CacheHierarchy::resetStats() {
+    stats.assign(configs.size(), LevelStats());
+    memory_reads = 0;
+    memory_writes = 0;
+    total_cycles = 0;
+    for (std::unique_ptr<Cache>& level : levels) {
+        level->resetStats();
+    }
+}
+
+void CacheHierarchy::processAccess(char operation, Address address) {
+    total_cycles += configs[0].hit_latency;
+    AccessResult result = levels[0]->access(operation, address);
+    count(0, operation, result.hit);
+    handleResult(0, operation, address, 4, result);
+}
+
+void CacheHierarchy::processTrace(const Access* accesses, size_t count) {
+    if (!configs[0].cache.split_accesses) {
+        for (size_t i = 0; i < count; i++) {
+            processAccess(accesses[i].operation, accesses[i].address);
+        }
+        return;
+    }
+
+    // accesses crossing an L1 block boundary become one per block
+    Address block_mask = ~Address(configs[0].cache.block_size - 1);
+    for (size_t i = 0; i < count; i++) {
+        Address first = accesses[i].address & block_mask;
+        Address last = (accesses[i].address + std::max<int>(accesses[i].size, 1) - 1) & block_mask;
+        processAccess(accesses[i].operation, accesses[i].address);
+        for (Address block = first + configs[0].cache.block_size; block <= last; block += configs[0].cache.block_size) {
+            processAccess(accesses[i].operation, block);
+        }
+    }
+}
+
+void CacheHierarchy::count(size_t level, char operation, bool hit) {
+    LevelStats& s = stats[level];
+    if (operation == 'l') {
+        s.loads++;
+        (hit ? s.load_hits : s.load_misses)++;
+    } else {
+        s.stores++;
+        (hit ? s.store_hits : s.store_misses)++;
+    }
+}
+
+void CacheHierarchy::memoryAccess(bool store, int bytes) {
+    // same cost model as a single CacheSimulator
+    if (store && bytes > 4) {
+        total_cycles += latency.writebackCycles(bytes);
+    } else {
+        total_cycles += latency.transferCycles(bytes);
+    }
+    (store ? memory_writes : memory_reads)++;
+}
+
+void CacheHierarchy::handleResult(size_t level, char operation, Address address, int bytes,
+                                  const AccessResult& result) {
+    const CacheConfig& config = configs[level].cache;
+    if (result.evicted) {
+        evicted(level, result);
+    }
+    if (result.filled) {
+        Address block = address & ~Address(config.block_size - 1);
+        if (fetch(level + 1, block, config.block_size)) {
+            // the block left an exclusive level modified and stays that way
+            // here, a write-through level has to hand the data back down
+            if (config.write_through) {
+                write(level + 1, block, config.block_size);
+            } else {
+                levels[level]->markDirty(block);
+            }
+        }
+    }
+    if (operation != 'l' && config.write_through) {
+        write(level + 1, address, bytes);
+    }
+}
+
+void CacheHierarchy::evicted(size_t level, const AccessResult& result) {
+    int block_size = configs[level].cache.block_size;
+
+    if (configs[level].inclusion == INCLUSION_INCLUSIVE) {
+        // nothing above may keep a copy of what this level no longer holds
+        for (size_t upper = 0; upper < level; upper++) {
+            int upper_size = configs[upper].cache.block_size;
+            for (int offset = 0; offset < block_size; offset += upper_size) {
+                bool dirty = false;
+                if (levels[upper]->invalidate(result.victim + offset, dirty)) {
+                    stats[level].back_invalidations++;
+                    if (dirty) {
+                        write(level + 1, result.victim + offset, upper_size);
+                    }
+                }
+            }
+        }
+    }
+
+    if (result.writeback) {
+        stats[level].writebacks++;
+        write(level + 1, result.victim, block_size);
+    } else if (level + 1 < levels.size() && configs[level + 1].inclusion == INCLUSION_EXCLUSIVE) {
+        // clean victims still move down into an exclusive level
+        total_cycles += configs[level + 1].hit_latency;
+        AccessResult below = levels[level + 1]->insert(result.victim, false);
+        if (below.evicted) {
+            evicted(level + 1, below);
+        }
+    }
+}
+
+bool CacheHierarchy::fetch(size_t level, Address address, int bytes) {
+    if (level == levels.size()) {
+        memoryAccess(false, bytes);
+        return false;
+    }
+
+    bool moved_dirty = false;
+    int block_size = configs[level].cache.block_size;
+    for (int offset = 0; offset < std::max(bytes, block_size); offset += block_size) {
+        Address block = (address + offset) & ~Address(block_size - 1);
+        total_cycles += configs[level].hit_latency;
+
+        if (configs[level].inclusion == INCLUSION_EXCLUSIVE) {
+            // a hit moves the block up, dirty bit and all, a miss is filled
+            // straight from below
+            bool dirty = false;
+            bool hit = levels[level]->invalidate(block, dirty);
+            count(level, 'l', hit);
+            moved_dirty |= hit ? dirty : fetch(level + 1, block, block_size);
+            continue;
+        }
+
+        AccessResult result = levels[level]->access('l', block);
+        count(level, 'l', result.hit);
+        handleResult(level, 'l', block, block_size, result);
+    }
+    return moved_dirty;
+}
+
+void CacheHierarchy::write(size_t level, Address address, int bytes) {
+    if (level == levels.size()) {
+        memoryAccess(true, bytes);
+        return;
+    }
+
+    int block_size = configs[level].cache.block_size;
+    for (int offset = 0; offset < std::max(bytes, block_size); offset += block_size) {
+        Address target = bytes < block_size ? address : address + offset;
+        int chunk = std::min(bytes, block_size);
+        total_cycles += configs[level].hit_latency;
+
+        if (configs[level].inclusion == INCLUSION_EXCLUSIVE) {
+            if (chunk == block_size) {
+                // a dirty victim from above, not an access of its own any
+                // more than a clean one is
+                AccessResult result = levels[level]->insert(target, true);
+                if (result.evicted) {
+                    evicted(level, result);
+                }
+            } else {
+                // partial writes pass through, dropping any stale copy here
+                bool dirty = false;
+                bool hit = levels[level]->invalidate(target, dirty);
+                count(level, 's', hit);
+                write(level + 1, dirty ? target & ~Address(block_size - 1) : target, dirty ? block_size : chunk);
+            }
+            continue;
+        }
+
+        AccessResult result = levels[level]->access('s', target);
+        count(level, 's', result.hit);
+        handleResult(level, 's', target, chunk, result);
+    }
+}
+
+void CacheHierarchy::printStats(std::ostream& out, const OutputOptions& output) const {
+    uint64_t accesses = stats[0].loads + stats[0].stores;
+    double acpa = accesses ? double(total_cycles) / accesses : 0;
+
+    if (output.format == FORMAT_JSON) {
+        out << "{\"levels\": [";
+        for (size_t level = 0; level < levels.size(); level++) {
+            const LevelStats& s = stats[level];
+            const CacheConfig& config = configs[level].cache;
+            CacheSpace space(config);
+            out << (level ? ", " : "") << "{\"sets\": " << config.num_sets
+                << ", \"blocks_per_set\": " << config.num_blocks
+                << ", \"block_size\": " << config.block_size
+                << ", \"write_allocate\": " << (config.write_allocate ? "true" : "false")
+                << ", \"write_through\": " << (config.write_through ? "true" : "false")
+                << ", \"policy\": \"" << policyName(config.policy) << "\""
+                << ", \"total_loads\": " << s.loads
+                << ", \"total_stores\": " << s.stores
+                << ", \"load_hits\": " << s.load_hits
+                << ", \"load_misses\": " << s.load_misses
+                << ", \"store_hits\": " << s.store_hits
+                << ", \"store_misses\": " << s.store_misses
+                << ", \"writebacks\": " << s.writebacks
+                << ", \"back_invalidations\": " << s.back_invalidations
+                << ", \"data_bytes\": " << space.data_bytes
+                << ", \"overhead_bytes\": " << space.overheadBytes() << "}";
+        }
+        out << "], \"memory_reads\": " << memory_reads
+            << ", \"memory_writes\": " << memory_writes
+            << ", \"total_cycles\": " << total_cycles
+            << ", \"acpa\": " << acpa << "}" << std::endl;
+        return;
+    }
+
+    for (size_t level = 0; level < levels.size(); level++) {
+        const LevelStats& s = stats[level];
+        out << "L" << level + 1 << ": " << formatCacheConfig(configs[level].cache) << std::endl;
+        out << "Total loads: " << s.loads << std::endl;
+        out << "Total stores: " << s.stores << std::endl;
+        out << "Load hits: " << s.load_hits << std::endl;
+        out << "Load misses: " << s.load_misses << std::endl;
+        out << "Store hits: " << s.store_hits << std::endl;
+        out << "Store misses: " << s.store_misses << std::endl;
+        out << "Writebacks: " << s.writebacks << std::endl;
+        if (configs[level].inclusion == INCLUSION_INCLUSIVE) {
+            out << "Back invalidations: " << s.back_invalidations << std::endl;
+        }
+        if (output.metrics) {
+            uint64_t requests = s.loads + s.stores;
+            CacheSpace space(configs[level].cache);
+            out << "Hit rate: " << (requests ? double(s.load_hits + s.store_hits) / requests : 0) << std::endl;
+            out << "Miss rate: " << (requests ? double(s.load_misses + s.store_misses) / requests : 0) << std::endl;
+            out << "Data bytes: " << space.data_bytes << std::endl;
+            out << "Total overhead bytes: " << space.overheadBytes() << std::endl;
+        }
+        out << std::endl;
+    }
+    out << "Memory reads: " << memory_reads << std::endl;
+    out << "Memory writes: " << memory_writes << std::endl;
+    out << "Total cycles: " << total_cycles << std::endl;
+    if (output.metrics) {
+        out << "Average cycles per access: " << acpa << std::endl;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "report.h"
+
+// how a level relates to the levels above it
+enum InclusionPolicy {
+    // non-inclusive non-exclusive, misses fill every level on the way up
+    INCLUSION_NINE,
+    // evicting a block also removes it from every level above
+    INCLUSION_INCLUSIVE,
+    // the level only holds victims from the level above, a hit moves the
+    // block up and out of it
+    INCLUSION_EXCLUSIVE
+};
+
+struct LevelConfig {
+    CacheConfig cache;
+    InclusionPolicy inclusion;
+    int hit_latency;
+};
+
+// one level per line: the six cache arguments, then optionally
+// inclusive, exclusive or nine and a hit latency in cycles (default 1).
+// the first line is L1, the inclusion policy of L1 is ignored
+bool readHierarchyFile(const std::string& path, std::vector<LevelConfig>& levels, std::ostream& err);
+
+// a chain of caches in front of memory, simulated in one pass: misses fetch
+// from the next level down, dirty victims and write-through stores are
+// written to it. each level counts the requests it sees from above
+class CacheHierarchy {
+private:
+    struct LevelStats {
+        uint64_t loads;
+        uint64_t stores;
+        uint64_t load_hits;
+        uint64_t load_misses;
+        uint64_t store_hits;
+        uint64_t store_misses;
+        uint64_t writebacks;
+        uint64_t back_invalidations;
+    };
+
+    std::vector<LevelConfig> configs;
+    std::vector<std::unique_ptr<Cache>> levels;
+    std::vector<LevelStats> stats;
+    LatencyModel latency;
+    uint64_t memory_reads;
+    uint64_t memory_writes;
+    uint64_t total_cycles;
+
+    void count(size_t level, char operation, bool hit);
+    // reads the block at address, bytes long, into the level above `level`.
+    // true if it comes up dirty, moved out of an exclusive level
+    bool fetch(size_t level, Address address, int bytes);
+    // writes bytes at address from the level above into `level`
+    void write(size_t level, Address address, int bytes);
+    // applies the side effects of an access of bytes at address to `level`
+    void handleResult(size_t level, char operation, Address address, int bytes, const AccessResult& result);
+    void evicted(size_t level, const AccessResult& result);
+    // a block transfer, or a single word for write-through stores
+    void memoryAccess(bool store, int bytes);
+
+public:
+    // latency sets the memory costs, each level's hit cost is its hit_latency
+    CacheHierarchy(const std::vector<LevelConfig>& configs, const LatencyModel& latency);
+
+    void processAccess(char operation, Address address);
+    void processTrace(const Access* accesses, size_t count);
+    // zeroes every counter but keeps the contents of the levels
+    void resetStats();
+    // text or json, metrics adds rates and space per level and the average
+    // cycles per CPU access to the text
+    void printStats(std::ostream& out = std::cout, const OutputOptions& output = OutputOptions()) const;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include "interval.h"
+
+static const size_t FLUSH_SIZE = 1 << 16;
+
+IntervalRecorder::IntervalRecorder(Cache& cache, uint64_t interval, bool binary, std::ostream& out)
+    : cache(cache), interval(interval), binary(binary), out(out), filled(0), rows(0), last(cache.getStats()) {
+    if (binary) {
+        unsigned char header[16];
+        std::copy(INTERVAL_MAGIC, INTERVAL_MAGIC + 4, header);
+        for (int i = 0; i < 2; i++) {
+            header[4 + i] = INTERVAL_VERSION >> (8 * i);
+            header[6 + i] = 0;
+        }
+        for (int i = 0; i < 8; i++) {
+            header[8 + i] = interval >> (8 * i);
+        }
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    } else {
+        out << "interval,records,loads,stores,load_hits,load_misses,store_hits,store_misses,"
+            << "total_cycles,miss_rate" << std::endl;
+    }
+}
+
+void IntervalRecorder::processTrace(const Access* accesses, size_t count) {
+    while (count > 0) {
+        size_t n = std::min<uint64_t>(count, interval - filled);
+        cache.processTrace(accesses, n);
+        accesses += n;
+        count -= n;
+        filled += n;
+        if (filled == interval) {
+            endInterval();
+        }
+    }
+}
+
+void IntervalRecorder::restart() {
+    filled = 0;
+    last = cache.getStats();
+}
+
+bool IntervalRecorder::finish() {
+    if (filled > 0) {
+        endInterval();
+    }
+    if (binary) {
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        buffer.clear();
+    }
+    return bool(out.flush());
+}
+
+void IntervalRecorder::writeVarint(uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(value);
+}
+
+void IntervalRecorder::endInterval() {
+    const CacheStats& now = cache.getStats();
+    uint64_t loads = now.total_loads - last.total_loads;
+    uint64_t stores = now.total_stores - last.total_stores;
+    uint64_t load_misses = now.load_misses - last.load_misses;
+    uint64_t store_misses = now.store_misses - last.store_misses;
+    uint64_t cycles = now.total_cycles - last.total_cycles;
+
+    if (binary) {
+        writeVarint(filled);
+        writeVarint(loads);
+        writeVarint(stores);
+        writeVarint(load_misses);
+        writeVarint(store_misses);
+        writeVarint(cycles);
+        if (buffer.size() >= FLUSH_SIZE) {
+            out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            buffer.clear();
+        }
+    } else {
+        uint64_t accesses = loads + stores;
+        out << rows << "," << filled << "," << loads << "," << stores << "," << loads - load_misses << ","
+            << load_misses << "," << stores - store_misses << "," << store_misses << "," << cycles << ","
+            << (accesses ? double(load_misses + store_misses) / accesses : 0) << "\n";
+    }
+    rows++;
+    filled = 0;
+    last = now;
+}
@@ -0,0 +1,48 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "cache.h"
+
+// interval time series layout, binary fields little endian:
+//   csv: a header row, then interval,records,loads,stores,load_hits,
+//        load_misses,store_hits,store_misses,total_cycles,miss_rate
+//   binary header: "CSTI", u16 version, u16 0, u64 interval
+//   binary row: varints of records, loads, stores, load misses, store misses
+//   and total cycles
+// records is the trace records in the interval, only the last one is short
+static const char INTERVAL_MAGIC[4] = {'C', 'S', 'T', 'I'};
+static const uint16_t INTERVAL_VERSION = 1;
+
+// feeds a cache interval trace records at a time and writes down what its
+// counters did over each interval. the counters are only read between
+// intervals, so the access loop runs exactly as it would without this
+class IntervalRecorder {
+private:
+    Cache& cache;
+    uint64_t interval;
+    bool binary;
+    std::ostream& out;
+    // records into the current interval, and the counters when it began
+    uint64_t filled;
+    uint64_t rows;
+    CacheStats last;
+    std::vector<unsigned char> buffer;
+
+    void writeVarint(uint64_t value);
+    void endInterval();
+
+public:
+    IntervalRecorder(Cache& cache, uint64_t interval, bool binary, std::ostream& out);
+
+    void processTrace(const Access* accesses, size_t count);
+    // starts counting afresh from the cache's counters, e.g. after a warmup
+    // reset them
+    void restart();
+    // writes the last, partial interval. false if out failed
+    bool finish();
+};
+
+#endif
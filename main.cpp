@@ -1,274 +1,845 @@
 #include <iostream>
 #include <cstring>
+#include <fstream>
 #include <cmath>
+#include <string>
 #include <vector>
 #include <map>
 #include <algorithm>
+#include "bench.h"
+#include "cache.h"
+#include "hierarchy.h"
+#include "interval.h"
+#include "multicore.h"
+#include "outcome.h"
+#include "parallel.h"
+#include "prefetch.h"
+#include "profile.h"
+#include "report.h"
+#include "server.h"
+#include "sweep.h"
+#include "trace.h"
 
-struct CacheBlock {
-    bool valid;
-    bool dirty;
-    unsigned int tag;
-    unsigned int lru_count;
-    
-    CacheBlock() : valid(false), dirty(false), tag(0), lru_count(0) {}
-};
-
-struct CacheSet {
-    std::vector<CacheBlock> blocks;
-    
-    CacheSet(int associativity) : blocks(associativity) {}
-};
-
-class CacheSimulator {
-private:
-    int num_sets;
-    int num_blocks_per_set;
-    int block_size;
-    bool write_allocate;
-    bool write_through;
-    bool lru_eviction;
-    
-    std::vector<CacheSet> sets;
-    unsigned int global_counter;
-    
-    // stats for the cache
-    int total_loads;
-    int total_stores;
-    int load_hits;
-    int load_misses;
-    int store_hits;
-    int store_misses;
-    int total_cycles;
-    
-    int set_bits;
-    int block_bits;
-    int tag_bits;
-    
-public:
-    CacheSimulator(int sets, int blocks_per_set, int bytes_per_block, 
-                   bool write_alloc, bool write_thru, bool lru) 
-        : num_sets(sets), num_blocks_per_set(blocks_per_set), block_size(bytes_per_block),
-          write_allocate(write_alloc), write_through(write_thru), lru_eviction(lru),
-          sets(sets, CacheSet(blocks_per_set)), global_counter(0),
-          total_loads(0), total_stores(0), load_hits(0), load_misses(0),
-          store_hits(0), store_misses(0), total_cycles(0) {
-        
-        // bit possitioning
-        set_bits = std::log2(num_sets);
-        block_bits = std::log2(block_size);
-        tag_bits = 32 - set_bits - block_bits;
+// ./csim --sweep <max sets> <max blocks per set> <bytes per block> <write-through|write-back>
+static int runSweep(const std::vector<std::string> &args, const CacheConfig &options,
+                    const OutputOptions &output, const TraceOptions &input, uint64_t warmup) {
+  if (args.size() != 4) {
+
+    std::cerr << "Incorect number of arguments for --sweep. Should be: "<<
+                            "\n - maximum number of sets in the cache (a positive power-of-2)"<<
+                            "\n - maximum number of blocks in each set (a positive power-of-2)"<<
+                            "\n - number of bytes in each block (a positive power-of-2, at least 4)"<<
+                            "\n - write-through or write-back" << std::endl;
+    return 1;
+
+  }
+
+  int max_sets, max_blocks, block_size;
+  if (!parsePowerOfTwo(args[0], max_sets) || !parsePowerOfTwo(args[1], max_blocks)) {
+
+    std::cerr << "maximum number of sets and blocks in each set must be powers of 2" << std::endl;
+    return 1;
+
+  }
+
+  if (!parsePowerOfTwo(args[2], block_size) || block_size < 4) {
+
+    std::cerr << "number of bytes in each block must be a positive power-of-2, at least 4" << std::endl;
+    return 1;
+
+  }
+
+  if (args[3] != "write-through" && args[3] != "write-back") {
+
+    std::cerr << "store write parameter must be write-through or write-back" << std::endl;
+    return 1;
+
+  }
+
+  StackDistanceSweep sweep(max_sets, max_blocks, block_size);
+
+  // the counts start over once the warmup has gone through
+  uint64_t seen = 0;
+  bool ok;
+  if (options.split_accesses) {
+    ok = readTrace(input, [&](char operation, Address address, int size) {
+      sweep.processSplitAccess(operation, address, size);
+      if (++seen == warmup) {
+        sweep.resetStats();
+      }
+    });
+  } else {
+    ok = readTrace(input, [&](char operation, Address address, int) {
+      sweep.processAccess(operation, address);
+      if (++seen == warmup) {
+        sweep.resetStats();
+      }
+    });
+  }
+  if (!ok) {
+    return 1;
+  }
+  if (seen < warmup) {
+    sweep.resetStats();
+  }
+
+  sweep.printStats(args[3] == "write-through", options.latency, output);
+
+  return 0;
+}
+
+// readTraceBatches, calling reset once the first warmup accesses have been
+// processed, or at the end if the trace is not even that long
+template <typename Process, typename Reset>
+static bool readWarmTrace(const TraceOptions &input, uint64_t warmup, Process process, Reset reset) {
+  bool ok = readTraceBatches(input, [&](const Access *accesses, size_t count) {
+    if (warmup > 0) {
+      size_t n = std::min<uint64_t>(count, warmup);
+      process(accesses, n);
+      warmup -= n;
+      if (warmup == 0) {
+        reset();
+      }
+      accesses += n;
+      count -= n;
+    }
+    if (count > 0) {
+      process(accesses, count);
     }
-    
-    void processAccess(char operation, unsigned int address) {
-        unsigned int set_index = (address >> block_bits) & ((1 << set_bits) - 1);
-        unsigned int tag = address >> (set_bits + block_bits);
-        
-        if (operation == 'l') {
-            processLoad(set_index, tag);
-        } else {
-            processStore(set_index, tag);
-        }
+  });
+  if (warmup > 0) {
+    reset();
+  }
+  return ok;
+}
+
+// ./csim --convert [--varint] < text.trace > binary.trace
+static int runConvert(const std::vector<std::string> &args, const TraceOptions &input, bool varint) {
+  if (!args.empty()) {
+
+    std::cerr << "--convert takes no positional arguments, it reads a text trace from stdin"
+              << " and writes a binary trace to stdout" << std::endl;
+    return 1;
+
+  }
+
+  BinaryTraceWriter writer(varint);
+  bool ok = true;
+  bool decoded = readTrace(input, [&](char operation, Address address, int size) {
+    if (!writer.add(operation, address, size)) {
+      ok = false;
     }
-    
-private:
-    void processLoad(unsigned int set_index, unsigned int tag) {
-        total_loads++;
-        total_cycles++;
-        CacheSet& set = sets[set_index];
-        
-        // if hit then increase the hit stat
-        for (int i = 0; i < num_blocks_per_set; i++) {
-            if (set.blocks[i].valid && set.blocks[i].tag == tag) {
-                load_hits++;
-                //only set to ++ global counter on hit if lru on load
-                if (lru_eviction) {
-                    set.blocks[i].lru_count = ++global_counter;
-                }
-                return;
-            }
-        }
-        // it was a miss
-        load_misses++;
-        total_cycles += 100 * (block_size / 4);
-        
-        allocateBlock(set, tag);
+  });
+  if (!decoded) {
+    return 1;
+  }
+
+  if (!ok) {
+
+    std::cerr << "access sizes must be between 0 and " << BINARY_TRACE_MAX_SIZE
+              << " bytes to fit the binary format" << std::endl;
+    return 1;
+
+  }
+
+  if (!writer.write(std::cout)) {
+
+    std::cerr << "failed to write binary trace" << std::endl;
+    return 1;
+
+  }
+
+  return 0;
+}
+
+// copies the settings given as options rather than positional arguments
+static void applyCacheOptions(const CacheConfig &options, CacheConfig &config) {
+  config.latency = options.latency;
+  config.address_bits = options.address_bits;
+  config.split_accesses = options.split_accesses;
+  config.sampling = options.sampling;
+  config.classify_misses = options.classify_misses;
+  config.prefetch = options.prefetch;
+  config.write_buffer = options.write_buffer;
+}
+
+// ./csim --configs <file> [--threads N] < trace
+static int runParallel(const std::vector<std::string> &args, const std::string &config_file,
+                       const CacheConfig &options, const OutputOptions &output, int threads,
+                       const TraceOptions &input, uint64_t warmup) {
+  if (!args.empty()) {
+
+    std::cerr << "--configs takes its cache configurations from the file, not the command line" << std::endl;
+    return 1;
+
+  }
+
+  std::vector<CacheConfig> configs;
+  if (!readConfigFile(config_file, configs, std::cerr)) {
+    return 1;
+  }
+  for (CacheConfig &config : configs) {
+    applyCacheOptions(options, config);
+  }
+
+  // decode once, every simulator shares the same buffer
+  std::vector<Access> trace;
+  if (!loadTrace(input, trace)) {
+    return 1;
+  }
+  runConfigs(trace, configs, threads, output, std::cout, warmup);
+
+  return 0;
+}
+
+// ./csim --hierarchy <file> < trace
+static int runHierarchy(const std::vector<std::string> &args, const std::string &hierarchy_file,
+                        const CacheConfig &options, const OutputOptions &output, const TraceOptions &input,
+                        uint64_t warmup) {
+  if (!args.empty()) {
+
+    std::cerr << "--hierarchy takes its cache levels from the file, not the command line" << std::endl;
+    return 1;
+
+  }
+
+  if (output.format == FORMAT_CSV) {
+
+    std::cerr << "--hierarchy output is text or json" << std::endl;
+    return 1;
+
+  }
+
+  std::vector<LevelConfig> levels;
+  if (!readHierarchyFile(hierarchy_file, levels, std::cerr)) {
+    return 1;
+  }
+
+  for (LevelConfig &level : levels) {
+    applyCacheOptions(options, level.cache);
+  }
+
+  CacheHierarchy hierarchy(levels, options.latency);
+  bool ok = readWarmTrace(input, warmup, [&](const Access *accesses, size_t count) {
+    hierarchy.processTrace(accesses, count);
+  }, [&]() {
+    hierarchy.resetStats();
+  });
+  if (!ok) {
+    return 1;
+  }
+  hierarchy.printStats(std::cout, output);
+
+  return 0;
+}
+
+// ./csim --multicore <file> [--interleave round-robin|cycles] [--quantum N] [--shared-memory]
+//        [--coherence msi] <traces>
+static int runMulticore(const std::vector<std::string> &args, const std::string &multicore_file,
+                        const CacheConfig &options, const MulticoreOptions &multicore,
+                        const OutputOptions &output, const TraceOptions &input, uint64_t warmup) {
+  if (args.empty()) {
+
+    std::cerr << "--multicore takes one trace file per core" << std::endl;
+    return 1;
+
+  }
+
+  if (output.format == FORMAT_CSV) {
+
+    std::cerr << "--multicore output is text or json" << std::endl;
+    return 1;
+
+  }
+
+  if (multicore.coherence && !multicore.shared_memory) {
+
+    std::cerr << "--coherence msi needs --shared-memory, cores with address spaces of their own"
+              << " never share a block" << std::endl;
+    return 1;
+
+  }
+
+  if (!multicore.shared_memory && options.address_bits + MulticoreSystem::coreBits(args.size()) > 64) {
+
+    std::cerr << "the core numbers of " << args.size() << " address spaces do not fit above "
+              << options.address_bits << " address bits, lower --address-bits or use --shared-memory"
+              << std::endl;
+    return 1;
+
+  }
+
+  std::vector<LevelConfig> levels;
+  if (!readMulticoreFile(multicore_file, levels, std::cerr)) {
+    return 1;
+  }
+  for (LevelConfig &level : levels) {
+    applyCacheOptions(options, level.cache);
+  }
+
+  std::vector<std::vector<Access>> traces;
+  for (const std::string &path : args) {
+    if (TraceFile(path).fd() < 0) {
+
+      std::cerr << "could not open trace file " << path << std::endl;
+      return 1;
+
     }
-    
-    void processStore(unsigned int set_index, unsigned int tag) {
-        total_stores++;
-        total_cycles++;
-        CacheSet& set = sets[set_index];
-        
-        for (int i = 0; i < num_blocks_per_set; i++) {
-            if (set.blocks[i].valid && set.blocks[i].tag == tag) {
-                store_hits++;
-                //only set to ++ global counter on hit if lru on store
-                if (lru_eviction) {
-                    set.blocks[i].lru_count = ++global_counter;
-                }
-                if (!write_through) {
-                    set.blocks[i].dirty = true;
-                } else {
-                    total_cycles += 100;
-                }
-                return;
-            }
-        }
-        store_misses++;
-        
-        if (write_allocate) {
-            total_cycles += 100 * (block_size / 4);
-            allocateBlock(set, tag);
-            if (!write_through) {
-                for (int i = 0; i < num_blocks_per_set; i++) {
-                    if (set.blocks[i].valid && set.blocks[i].tag == tag) {
-                        set.blocks[i].dirty = true;
-                        break;
-                    }
-                }
-            } else {
-                total_cycles += 100;
-            }
-        } else {
-            total_cycles += 100;
-        }
+    TraceOptions core_input = input;
+    core_input.path = path;
+    traces.emplace_back();
+    if (!loadTrace(core_input, traces.back())) {
+      return 1;
     }
-    
-    void allocateBlock(CacheSet& set, unsigned int tag) {
-        for (int i = 0; i < num_blocks_per_set; i++) {
-            if (!set.blocks[i].valid) {
-                set.blocks[i].valid = true;
-                set.blocks[i].tag = tag;
-                set.blocks[i].lru_count = ++global_counter;
-                set.blocks[i].dirty = false;
-                return;
-            }
-        }
-        evictBlock(set, tag);
+  }
+
+  MulticoreSystem system(levels[0], levels[1], traces.size(), options.latency, multicore);
+  system.run(traces, warmup);
+  system.printStats(args, std::cout, output);
+
+  return 0;
+}
+
+// reads the cycle count following a latency option
+static bool parseCycles(const char *option, const char *value, long long &cycles) {
+  char *end;
+  cycles = std::strtoll(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || cycles < 0) {
+
+    std::cerr << option << " takes a non-negative number of cycles" << std::endl;
+    return false;
+
+  }
+  return true;
+}
+
+// reads the access count following a sampling option
+static bool parseCount(const char *option, const char *value, uint64_t &count) {
+  char *end;
+  count = std::strtoull(value, &end, 10);
+  if (*value == '\0' || *value == '-' || *end != '\0') {
+
+    std::cerr << option << " takes a non-negative number of accesses" << std::endl;
+    return false;
+
+  }
+  return true;
+}
+
+// the sampling options that make sense together, printing why not otherwise
+static bool checkSampling(const SamplingConfig &sampling, bool partition, bool sweep, bool hierarchy) {
+  if (!sampling.enabled()) {
+    return true;
+  }
+  if (partition || sweep || hierarchy) {
+
+    std::cerr << "sampling does not work with --partition, --sweep or --hierarchy" << std::endl;
+    return false;
+
+  }
+  if (sampling.period == 0 && (sampling.window > 0 || sampling.warmup > 0)) {
+
+    std::cerr << "--sample-window and --sample-warmup need --sample-period" << std::endl;
+    return false;
+
+  }
+  if (sampling.period > 0 && (sampling.window == 0 || sampling.warmup + sampling.window > sampling.period)) {
+
+    std::cerr << "--sample-window must be at least 1 and fit in --sample-period with the warmup" << std::endl;
+    return false;
+
+  }
+  return true;
+}
+
+int main( int argc, char **argv ) {
+  // options start with --, everything else is positional
+  bool sweep = false;
+  bool bench = false;
+  bool serve = false;
+  std::string socket_path;
+  bool convert = false;
+  bool varint = false;
+  TraceOptions input;
+  bool partition = false;
+  bool fixed_ways = true;
+  OutputOptions output;
+  // the cache settings that are options rather than positional arguments
+  CacheConfig options;
+  long long cycles;
+  uint64_t count;
+  std::string config_file;
+  std::string hierarchy_file;
+  std::string outcome_dir;
+  std::string multicore_file;
+  MulticoreOptions multicore;
+  uint64_t warmup = 0;
+  std::string checkpoint_file;
+  std::string restore_file;
+  uint64_t interval = 0;
+  std::string interval_file;
+  bool interval_binary = false;
+  uint64_t profile_top = 0;
+  int threads = defaultThreadCount();
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--sweep") == 0) {
+      sweep = true;
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      bench = true;
+    } else if (strcmp(argv[i], "--serve") == 0) {
+      serve = true;
+    } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--convert") == 0) {
+      convert = true;
+    } else if (strcmp(argv[i], "--varint") == 0) {
+      varint = true;
+    } else if (strcmp(argv[i], "--fast") == 0) {
+      input.fast = true;
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      input.path = argv[++i];
+      if (TraceFile(input.path).fd() < 0) {
+
+        std::cerr << "could not open trace file " << input.path << std::endl;
+        return 1;
+
+      }
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      input.pipelined = true;
+    } else if (strcmp(argv[i], "--no-fixed-ways") == 0) {
+      fixed_ways = false;
+    } else if (strcmp(argv[i], "--partition") == 0) {
+      partition = true;
+    } else if (strcmp(argv[i], "--metrics") == 0) {
+      output.metrics = true;
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      if (!parseFormat(argv[++i], output.format)) {
+
+        std::cerr << "--format must be text, json or csv" << std::endl;
+        return 1;
+
+      }
+    } else if (strcmp(argv[i], "--hit-cycles") == 0 && i + 1 < argc) {
+      if (!parseCycles(argv[i], argv[i + 1], cycles)) {
+        return 1;
+      }
+      options.latency.hit_cycles = cycles;
+      i++;
+    } else if (strcmp(argv[i], "--memory-latency") == 0 && i + 1 < argc) {
+      if (!parseCycles(argv[i], argv[i + 1], cycles)) {
+        return 1;
+      }
+      options.latency.memory_latency = cycles;
+      i++;
+    } else if (strcmp(argv[i], "--word-cycles") == 0 && i + 1 < argc) {
+      if (!parseCycles(argv[i], argv[i + 1], cycles)) {
+        return 1;
+      }
+      options.latency.word_cycles = cycles;
+      i++;
+    } else if (strcmp(argv[i], "--writeback-cycles") == 0 && i + 1 < argc) {
+      if (!parseCycles(argv[i], argv[i + 1], cycles)) {
+        return 1;
+      }
+      options.latency.writeback_cycles = cycles;
+      i++;
+    } else if (strcmp(argv[i], "--classify") == 0) {
+      options.classify_misses = true;
+    } else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+      if (!parsePrefetcher(argv[++i], options.prefetch.kind)) {
+
+        std::cerr << "--prefetch must be none, next-line, stream or tagged" << std::endl;
+        return 1;
+
+      }
+    } else if (strcmp(argv[i], "--prefetch-degree") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], count) || count < 1 || count > 64) {
+
+        std::cerr << "--prefetch-degree takes how many blocks to fetch ahead, 1 to 64" << std::endl;
+        return 1;
+
+      }
+      options.prefetch.degree = count;
+      i++;
+    } else if (strcmp(argv[i], "--write-buffer") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], count) || count < 1 || count > 1024) {
+
+        std::cerr << "--write-buffer takes the number of entries, 1 to 1024" << std::endl;
+        return 1;
+
+      }
+      options.write_buffer = count;
+      i++;
+    } else if (strcmp(argv[i], "--split-accesses") == 0) {
+      options.split_accesses = true;
+    } else if (strcmp(argv[i], "--sample-sets") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], count) || count < 1 || count > UINT32_MAX) {
+
+        std::cerr << "--sample-sets takes how many sets to have per simulated one, at least 1" << std::endl;
+        return 1;
+
+      }
+      options.sampling.set_ratio = count;
+      i++;
+    } else if (strcmp(argv[i], "--sample-period") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], options.sampling.period)) {
+        return 1;
+      }
+      i++;
+    } else if (strcmp(argv[i], "--sample-window") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], options.sampling.window)) {
+        return 1;
+      }
+      i++;
+    } else if (strcmp(argv[i], "--sample-warmup") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], options.sampling.warmup)) {
+        return 1;
+      }
+      i++;
+    } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], warmup)) {
+        return 1;
+      }
+      i++;
+    } else if (strcmp(argv[i], "--interval") == 0 && i + 2 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], interval) || interval == 0) {
+
+        std::cerr << "--interval takes the number of accesses per interval and the file to write them to"
+                  << std::endl;
+        return 1;
+
+      }
+      interval_file = argv[i + 2];
+      i += 2;
+    } else if (strcmp(argv[i], "--interval-binary") == 0) {
+      interval_binary = true;
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], profile_top) || profile_top == 0 || profile_top > UINT32_MAX / 8) {
+
+        std::cerr << "--profile takes how many sets and blocks to show, at least 1" << std::endl;
+        return 1;
+
+      }
+      i++;
+    } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+      checkpoint_file = argv[++i];
+    } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+      restore_file = argv[++i];
+    } else if (strcmp(argv[i], "--address-bits") == 0 && i + 1 < argc) {
+      options.address_bits = std::atoi(argv[++i]);
+      if (options.address_bits < 32 || options.address_bits > 64) {
+
+        std::cerr << "--address-bits must be between 32 and 64" << std::endl;
+        return 1;
+
+      }
+    } else if (strcmp(argv[i], "--configs") == 0 && i + 1 < argc) {
+      config_file = argv[++i];
+    } else if (strcmp(argv[i], "--hierarchy") == 0 && i + 1 < argc) {
+      hierarchy_file = argv[++i];
+    } else if (strcmp(argv[i], "--outcome-cache") == 0 && i + 1 < argc) {
+      outcome_dir = argv[++i];
+    } else if (strcmp(argv[i], "--multicore") == 0 && i + 1 < argc) {
+      multicore_file = argv[++i];
+    } else if (strcmp(argv[i], "--interleave") == 0 && i + 1 < argc) {
+      if (!parseInterleave(argv[++i], multicore.order)) {
+
+        std::cerr << "--interleave must be round-robin or cycles" << std::endl;
+        return 1;
+
+      }
+    } else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) {
+      if (!parseCount(argv[i], argv[i + 1], multicore.quantum) || multicore.quantum == 0) {
+
+        std::cerr << "--quantum takes how many accesses each core runs per turn, at least 1" << std::endl;
+        return 1;
+
+      }
+      i++;
+    } else if (strcmp(argv[i], "--shared-memory") == 0) {
+      multicore.shared_memory = true;
+    } else if (strcmp(argv[i], "--coherence") == 0 && i + 1 < argc) {
+      if (strcmp(argv[++i], "msi") == 0) {
+        multicore.coherence = true;
+      } else if (strcmp(argv[i], "none") == 0) {
+        multicore.coherence = false;
+      } else {
+
+        std::cerr << "--coherence must be msi or none" << std::endl;
+        return 1;
+
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+      if (threads < 1) {
+
+        std::cerr << "--threads must be at least 1" << std::endl;
+        return 1;
+
+      }
+    } else {
+      args.push_back(argv[i]);
     }
-    // make room for new blocks
-    void evictBlock(CacheSet& set, unsigned int tag) {
-        int evict_index = 0;
-        
-        unsigned int min_counter = set.blocks[0].lru_count;
-        for (int i = 1; i < num_blocks_per_set; i++) {
-            if (set.blocks[i].lru_count < min_counter) {
-                min_counter = set.blocks[i].lru_count;
-                evict_index = i;
-            }
-        }
-    
-        if (set.blocks[evict_index].dirty && !write_through) {
-            total_cycles += 100 * (block_size / 4); // Writeback to memory
-        }
-
-        set.blocks[evict_index].valid = true;
-        set.blocks[evict_index].tag = tag;
-        set.blocks[evict_index].lru_count = ++global_counter; //new block is most recently used and last in
-        set.blocks[evict_index].dirty = false;
+  }
+
+  if (convert) {
+    return runConvert(args, input, varint);
+  }
+
+  // ./csim --bench [--fast] [trace files, gcc.trace and swim.trace by default]
+  if (bench) {
+    if (args.empty()) {
+      args = {"gcc.trace", "swim.trace"};
     }
-    
-public:
-    void printStats() {
-        std::cout << "Total loads: " << total_loads << std::endl;
-        std::cout << "Total stores: " << total_stores << std::endl;
-        std::cout << "Load hits: " << load_hits << std::endl;
-        std::cout << "Load misses: " << load_misses << std::endl;
-        std::cout << "Store hits: " << store_hits << std::endl;
-        std::cout << "Store misses: " << store_misses << std::endl;
-        std::cout << "Total cycles: " << total_cycles << std::endl;
+    return runBenchmark(args, input, output, std::cout) ? 0 : 1;
+  }
+
+  // ./csim --serve [--socket PATH] [--threads N] [cache options], the
+  // requests name their own traces and caches
+  if (serve || !socket_path.empty()) {
+    if (!args.empty() || sweep || partition || !hierarchy_file.empty() || !config_file.empty()
+        || !multicore_file.empty() || !input.path.empty() || options.sampling.enabled() || warmup > 0
+        || profile_top > 0 || interval > 0 || !checkpoint_file.empty() || !restore_file.empty()) {
+
+      std::cerr << "--serve only takes --socket, --threads, --outcome-cache and the cache options,"
+                << " every request names its own trace and cache" << std::endl;
+      return 1;
+
     }
-};
+    ServerOptions server;
+    server.threads = threads;
+    server.socket_path = socket_path;
+    server.defaults = options;
+    server.outcome_dir = outcome_dir;
+    return runServer(server);
+  }
 
-int main( int argc, char **argv ) {
-  if (argc != 7) {
-    
-    std::cerr << "Incorect number of arguments. Should be: "<<
-                            "\n - number of sets in the cache (a positive power-of-2)"<<
-                            "\n - number of blocks in each set (a positive power-of-2)"<<
-                            "\n - number of bytes in each block (a positive power-of-2, at least 4)"<<
-                            "\n - write-allocate or no-write-allocate"<<
-                            "\n - write-through or write-back"<<
-                            "\n - lru (least-recently-used) or fifo evictions" << std::endl;
+  if (!checkSampling(options.sampling, partition, sweep, !hierarchy_file.empty())) {
+    return 1;
+  }
+
+  if (warmup > 0 && options.sampling.enabled()) {
+
+    std::cerr << "--warmup does not work with sampling, use --sample-warmup" << std::endl;
     return 1;
 
   }
 
-  if (std::floor(std::log2(std::atoi(argv[1]))) != std::log2(std::atoi(argv[1]))) {
+  if ((!checkpoint_file.empty() || !restore_file.empty())
+      && (sweep || partition || options.sampling.enabled() || options.classify_misses || options.prefetch.enabled()
+          || !hierarchy_file.empty() || !config_file.empty())) {
 
-    std::cerr << "number of sets in cache must be a power of 2" << std::endl;
+    std::cerr << "--checkpoint and --restore only work for a single cache, without sampling, --classify"
+              << " or --prefetch" << std::endl;
     return 1;
 
   }
 
-  if (std::floor(std::log2(std::atoi(argv[2]))) != std::log2(std::atoi(argv[2]))) {
+  if (options.classify_misses && (sweep || partition || options.sampling.enabled() || !hierarchy_file.empty())) {
 
-    std::cerr << "number of blocks in each set must a be power of 2" << std::endl;
+    std::cerr << "--classify does not work with --sweep, --partition, --hierarchy or sampling" << std::endl;
     return 1;
-    
+
   }
 
-  if (std::floor(std::log2(std::atoi(argv[3]))) != std::log2(std::atoi(argv[3])) || std::atoi(argv[3]) < 4) {
+  if (options.prefetch.enabled()
+      && (sweep || partition || options.sampling.enabled() || options.classify_misses || !hierarchy_file.empty())) {
 
-    std::cerr << "number of bytes in each block must be a positive power-of-2, at least 4" << std::endl;
+    std::cerr << "--prefetch does not work with --sweep, --partition, --hierarchy, --classify or sampling" << std::endl;
     return 1;
-    
+
   }
 
-  if (strcmp(argv[4], "write-allocate") != 0 && strcmp(argv[4], "no-write-allocate") != 0) {
+  if (options.write_buffer > 0 && (sweep || partition || options.sampling.enabled() || !hierarchy_file.empty())) {
 
-    std::cerr << "cache miss parameter must be write-allocate or no-write-allocate" << std::endl;
+    std::cerr << "--write-buffer does not work with --sweep, --partition, --hierarchy or sampling" << std::endl;
     return 1;
-    
+
   }
 
-  if (strcmp(argv[5], "write-through") != 0 && strcmp(argv[5], "write-back") != 0) {
+  if (profile_top > 0) {
+    if (sweep || partition || options.sampling.enabled() || !hierarchy_file.empty() || !config_file.empty()
+        || !checkpoint_file.empty() || !restore_file.empty()) {
 
-    std::cerr << "store write parameter must be write-through or write-back" << std::endl;
+      std::cerr << "--profile only works for a single cache, without sampling or checkpoints" << std::endl;
+      return 1;
+
+    }
+    if (output.format == FORMAT_CSV) {
+
+      std::cerr << "--profile output is text or json" << std::endl;
+      return 1;
+
+    }
+  }
+
+  if (interval > 0
+      && (sweep || partition || options.sampling.enabled() || !hierarchy_file.empty() || !config_file.empty())) {
+
+    std::cerr << "--interval only works for a single, unsampled cache" << std::endl;
+    return 1;
+
+  }
+
+  if (!multicore_file.empty()) {
+    if (sweep || partition || !hierarchy_file.empty() || !config_file.empty() || !input.path.empty()
+        || options.sampling.enabled() || options.classify_misses || options.prefetch.enabled()
+        || options.write_buffer > 0 || profile_top > 0 || interval > 0 || !checkpoint_file.empty()
+        || !restore_file.empty() || !outcome_dir.empty()) {
+
+      std::cerr << "--multicore only takes the latency, address, --split-accesses, --warmup and output options"
+                << std::endl;
+      return 1;
+
+    }
+    return runMulticore(args, multicore_file, options, multicore, output, input, warmup);
+  }
+
+  if (!outcome_dir.empty()
+      && (sweep || partition || !hierarchy_file.empty() || !config_file.empty() || options.sampling.enabled()
+          || options.classify_misses || options.prefetch.enabled() || profile_top > 0 || interval > 0
+          || !checkpoint_file.empty() || !restore_file.empty())) {
+
+    std::cerr << "--outcome-cache only works for a single cache, without sampling, --classify, --prefetch,"
+              << " --profile, --interval or checkpoints" << std::endl;
     return 1;
-    
+
   }
 
-  if (strcmp(argv[6], "lru") != 0 && strcmp(argv[6], "fifo") != 0) {
+  if (sweep) {
+    return runSweep(args, options, output, input, warmup);
+  }
+
+  if (!hierarchy_file.empty()) {
+    return runHierarchy(args, hierarchy_file, options, output, input, warmup);
+  }
+
+  if (!config_file.empty()) {
+    return runParallel(args, config_file, options, output, threads, input, warmup);
+  }
 
-    std::cerr << "eviction parameter must be lru of fifo" << std::endl;
+  CacheConfig config;
+  if (!parseCacheConfig(args, config, std::cerr)) {
     return 1;
-    
   }
+  applyCacheOptions(options, config);
 
-  // Parse arguments
-  int num_sets = std::atoi(argv[1]);
-  int num_blocks = std::atoi(argv[2]);
-  int block_size = std::atoi(argv[3]);
-  bool write_allocate = (strcmp(argv[4], "write-allocate") == 0);
-  bool write_through = (strcmp(argv[5], "write-through") == 0);
-  bool lru = (strcmp(argv[6], "lru") == 0);
-  
-  // Check for invalid combination
-  if (!write_allocate && !write_through) {
+  if (config.write_buffer > 0 && !config.write_through) {
 
-    std::cerr << "no-write-allocate and write-back is an invalid combination" << std::endl;
+    std::cerr << "--write-buffer only applies to write-through caches" << std::endl;
     return 1;
 
   }
+
+  // the counters from the outcomes of an earlier run of the same trace and
+  // geometry when there was one, otherwise simulated once and saved for next time
+  if (!outcome_dir.empty()) {
+    std::vector<Access> trace;
+    if (!loadTrace(input, trace)) {
+      return 1;
+    }
+    OutcomeLog log;
+    if (!cachedOutcomes(outcome_dir, trace, hashTrace(trace), config, log, std::cerr)) {
+      return 1;
+    }
+    if (output.format == FORMAT_CSV) {
+      printCsvHeader(std::cout);
+    }
+    printReport(config, replayOutcomes(trace, log, config, warmup), output, false, std::cout);
+    return 0;
+  }
+
+  // split the sets of one cache across the worker threads
+  if (partition) {
+    std::vector<Access> trace;
+    if (!loadTrace(input, trace)) {
+      return 1;
+    }
+    if (output.format == FORMAT_CSV) {
+      printCsvHeader(std::cout);
+    }
+    printReport(config, runPartitioned(trace, config, threads, warmup), output, false, std::cout);
+    return 0;
+  }
   
   // Create cache simulator
-  CacheSimulator cache(num_sets, num_blocks, block_size, write_allocate, write_through, lru);
+  std::unique_ptr<Cache> cache = makeCache(config, fixed_ways);
+  ProfiledCache *profile = nullptr;
+  if (profile_top > 0) {
+    profile = new ProfiledCache(std::move(cache), config, profile_top);
+    cache.reset(profile);
+  }
+  if (!restore_file.empty()) {
+    std::ifstream in(restore_file, std::ios::binary);
+    if (!in) {
+
+      std::cerr << "could not open checkpoint file " << restore_file << std::endl;
+      return 1;
+
+    }
+    if (!cache->loadCheckpoint(in, std::cerr)) {
+      return 1;
+    }
+  }
   
-  // Read trace from stdin
-  char operation;
-  std::string address_str;
-  int size;
+  std::ofstream interval_out;
+  std::unique_ptr<IntervalRecorder> recorder;
+  if (interval > 0) {
+    interval_out.open(interval_file, interval_binary ? std::ios::binary : std::ios::out);
+    if (!interval_out) {
+
+      std::cerr << "could not open interval file " << interval_file << std::endl;
+      return 1;
+
+    }
+    recorder.reset(new IntervalRecorder(*cache, interval, interval_binary, interval_out));
+  }
   
-  while (std::cin >> operation >> address_str >> size) {
-    // Parse hexadecimal address
-    unsigned int address = std::stoul(address_str, nullptr, 16);
-    cache.processAccess(operation, address);
+  // Read trace from stdin, the intervals start after the warmup
+  bool warm = warmup == 0;
+  bool decoded = readWarmTrace(input, warmup, [&](const Access *accesses, size_t count) {
+    if (recorder && warm) {
+      recorder->processTrace(accesses, count);
+    } else {
+      cache->processTrace(accesses, count);
+    }
+  }, [&]() {
+    cache->resetStats();
+    warm = true;
+    if (recorder) {
+      recorder->restart();
+    }
+  });
+  if (!decoded) {
+    return 1;
+  }
+
+  if (recorder && !recorder->finish()) {
+
+    std::cerr << "could not write interval file " << interval_file << std::endl;
+    return 1;
+
+  }
+
+  if (!checkpoint_file.empty()) {
+    std::ofstream out(checkpoint_file, std::ios::binary);
+    if (!cache->saveCheckpoint(out) || !out.flush()) {
+
+      std::cerr << "could not write checkpoint file " << checkpoint_file << std::endl;
+      return 1;
+
+    }
   }
   
   // Print statistics
-  cache.printStats();
+  if (output.format == FORMAT_CSV) {
+    printCsvHeader(std::cout);
+  }
+  printReport(config, cache->getStats(), output, false, std::cout);
+  if (profile) {
+    printProfile(*profile, profile_top, output, std::cout);
+  }
   
   return 0;
 }
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include "multicore.h"
+
+bool parseInterleave(const std::string& name, InterleaveOrder& order) {
+    if (name == "round-robin") {
+        order = INTERLEAVE_ROUND_ROBIN;
+    } else if (name == "cycles") {
+        order = INTERLEAVE_CYCLES;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool readMulticoreFile(const std::string& path, std::vector<LevelConfig>& levels, std::ostream& err) {
+    if (!readHierarchyFile(path, levels, err)) {
+        return false;
+    }
+    if (levels.size() != 2) {
+        err << path << ": expected two levels, the private L1 and the shared cache" << std::endl;
+        return false;
+    }
+    if (levels[1].inclusion == INCLUSION_EXCLUSIVE) {
+        err << path << ": the shared cache must be inclusive or nine" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int MulticoreSystem::coreBits(size_t cores) {
+    int bits = 0;
+    while ((size_t(1) << bits) < cores) {
+        bits++;
+    }
+    return bits;
+}
+
+MulticoreSystem::MulticoreSystem(const LevelConfig& private_level, const LevelConfig& shared_level, size_t cores,
+                                 const LatencyModel& latency, const MulticoreOptions& options)
+    : private_level(private_level), shared_level(shared_level), options(options), latency(latency),
+      cores(cores), llc_stats(), memory_reads(0), memory_writes(0), core_shift(0), address_mask(~Address(0)) {
+    if (!options.shared_memory && coreBits(cores) > 0) {
+        // the caches get the extra tag bits the core numbers take
+        core_shift = private_level.cache.address_bits;
+        address_mask = (Address(1) << core_shift) - 1;
+        this->private_level.cache.address_bits += coreBits(cores);
+        this->shared_level.cache.address_bits += coreBits(cores);
+    }
+    llc = makeCache(this->shared_level.cache);
+    for (Core& core : this->cores) {
+        core.l1 = makeCache(this->private_level.cache);
+        core.stats = LevelStats();
+    }
+}
+
+void MulticoreSystem::resetStats() {
+    for (Core& core : cores) {
+        core.l1->resetStats();
+        core.stats = LevelStats();
+    }
+    llc->resetStats();
+    llc_stats = LevelStats();
+    memory_reads = 0;
+    memory_writes = 0;
+}
+
+void MulticoreSystem::count(LevelStats& stats, char operation, bool hit) {
+    if (operation == 'l') {
+        stats.loads++;
+        (hit ? stats.load_hits : stats.load_misses)++;
+    } else {
+        stats.stores++;
+        (hit ? stats.store_hits : stats.store_misses)++;
+    }
+}
+
+void MulticoreSystem::processAccess(size_t core, char operation, Address address) {
+    if (core_shift) {
+        address = (address & address_mask) | Address(core) << core_shift;
+    }
+    int block_size = private_level.cache.block_size;
+    Address block = address & ~Address(block_size - 1);
+    LevelStats& stats = cores[core].stats;
+    stats.cycles += private_level.hit_latency;
+
+    // the other cores only act before anything of this access reaches the
+    // LLC, so looking at its own L1 first changes nothing
+    AccessResult result = cores[core].l1->access(operation, address);
+    count(stats, operation, result.hit);
+    if (options.coherence && (operation != 'l' || !result.hit)) {
+        snoop(core, operation, block);
+    }
+    if (result.writeback) {
+        stats.writebacks++;
+        writeShared(core, result.victim, block_size);
+    }
+    if (result.filled) {
+        readShared(core, block, block_size);
+    }
+    if (operation != 'l' && private_level.cache.write_through) {
+        writeShared(core, address, 4);
+    }
+}
+
+void MulticoreSystem::snoop(size_t core, char operation, Address block) {
+    // not called for a load hit: a core holding the block means no other
+    // core has it modified. a store hit still has to take the shared copies
+    int block_size = private_level.cache.block_size;
+    for (size_t other = 0; other < cores.size(); other++) {
+        if (other == core) {
+            continue;
+        }
+        LevelStats& stats = cores[other].stats;
+        if (operation == 'l') {
+            if (cores[other].l1->clean(block)) {
+                stats.downgrades++;
+                writeShared(core, block, block_size);
+            }
+            continue;
+        }
+        bool dirty = false;
+        if (cores[other].l1->invalidate(block, dirty)) {
+            stats.invalidations++;
+            if (dirty) {
+                stats.downgrades++;
+                writeShared(core, block, block_size);
+            }
+        }
+    }
+}
+
+void MulticoreSystem::readShared(size_t core, Address address, int bytes) {
+    int block_size = shared_level.cache.block_size;
+    for (int offset = 0; offset < std::max(bytes, block_size); offset += block_size) {
+        Address block = (address + offset) & ~Address(block_size - 1);
+        cores[core].stats.cycles += shared_level.hit_latency;
+        AccessResult result = llc->access('l', block);
+        count(llc_stats, 'l', result.hit);
+        handleShared(core, 'l', block_size, result);
+    }
+}
+
+void MulticoreSystem::writeShared(size_t core, Address address, int bytes) {
+    int block_size = shared_level.cache.block_size;
+    for (int offset = 0; offset < std::max(bytes, block_size); offset += block_size) {
+        Address target = bytes < block_size ? address : address + offset;
+        int chunk = std::min(bytes, block_size);
+        cores[core].stats.cycles += shared_level.hit_latency;
+        AccessResult result = llc->access('s', target);
+        count(llc_stats, 's', result.hit);
+        handleShared(core, 's', chunk, result);
+    }
+}
+
+void MulticoreSystem::handleShared(size_t core, char operation, int bytes, const AccessResult& result) {
+    const CacheConfig& config = shared_level.cache;
+    if (result.evicted && shared_level.inclusion == INCLUSION_INCLUSIVE) {
+        // no core may keep a copy of what the LLC no longer holds
+        int upper_size = private_level.cache.block_size;
+        for (Core& upper : cores) {
+            for (int offset = 0; offset < config.block_size; offset += upper_size) {
+                bool dirty = false;
+                if (upper.l1->invalidate(result.victim + offset, dirty)) {
+                    llc_stats.invalidations++;
+                    if (dirty) {
+                        memoryAccess(core, true, upper_size);
+                    }
+                }
+            }
+        }
+    }
+    if (result.writeback) {
+        llc_stats.writebacks++;
+        memoryAccess(core, true, config.block_size);
+    }
+    if (result.filled) {
+        memoryAccess(core, false, config.block_size);
+    }
+    if (operation != 'l' && config.write_through) {
+        memoryAccess(core, true, bytes);
+    }
+}
+
+void MulticoreSystem::memoryAccess(size_t core, bool store, int bytes) {
+    // same cost model as CacheHierarchy
+    if (store && bytes > 4) {
+        cores[core].stats.cycles += latency.writebackCycles(bytes);
+    } else {
+        cores[core].stats.cycles += latency.transferCycles(bytes);
+    }
+    (store ? memory_writes : memory_reads)++;
+}
+
+void MulticoreSystem::run(const std::vector<std::vector<Access>>& traces, uint64_t warmup) {
+    std::vector<size_t> next(traces.size(), 0);
+    int block_bits = std::log2(private_level.cache.block_size);
+    bool warm = warmup == 0;
+    uint64_t seen = 0;
+
+    auto step = [&](size_t core) {
+        const Access& access = traces[core][next[core]++];
+        if (private_level.cache.split_accesses) {
+            forEachBlock(access.address, access.size, block_bits,
+                         [&](Address address) { processAccess(core, access.operation, address); });
+        } else {
+            processAccess(core, access.operation, access.address);
+        }
+        if (!warm && ++seen == warmup) {
+            resetStats();
+            warm = true;
+        }
+    };
+
+    if (options.order == INTERLEAVE_ROUND_ROBIN) {
+        bool any = true;
+        while (any) {
+            any = false;
+            for (size_t core = 0; core < traces.size(); core++) {
+                for (uint64_t i = 0; i < options.quantum && next[core] < traces[core].size(); i++) {
+                    step(core);
+                    any = true;
+                }
+            }
+        }
+    } else {
+        for (;;) {
+            // ties go to the lowest core
+            size_t behind = traces.size();
+            for (size_t core = 0; core < traces.size(); core++) {
+                if (next[core] < traces[core].size()
+                    && (behind == traces.size() || cores[core].stats.cycles < cores[behind].stats.cycles)) {
+                    behind = core;
+                }
+            }
+            if (behind == traces.size()) {
+                break;
+            }
+            step(behind);
+        }
+    }
+    if (!warm) {
+        resetStats();
+    }
+}
+
+static double share(uint64_t part, uint64_t whole) {
+    return whole ? double(part) / whole : 0;
+}
+
+void MulticoreSystem::printStats(const std::vector<std::string>& names, std::ostream& out,
+                                 const OutputOptions& output) const {
+    LevelStats all = LevelStats();
+    for (const Core& core : cores) {
+        all.loads += core.stats.loads;
+        all.stores += core.stats.stores;
+        all.load_hits += core.stats.load_hits;
+        all.load_misses += core.stats.load_misses;
+        all.store_hits += core.stats.store_hits;
+        all.store_misses += core.stats.store_misses;
+        all.writebacks += core.stats.writebacks;
+        all.invalidations += core.stats.invalidations;
+        all.downgrades += core.stats.downgrades;
+        all.cycles += core.stats.cycles;
+    }
+
+    if (output.format == FORMAT_JSON) {
+        auto counters = [&](const LevelStats& s) {
+            out << "\"total_loads\": " << s.loads
+                << ", \"total_stores\": " << s.stores
+                << ", \"load_hits\": " << s.load_hits
+                << ", \"load_misses\": " << s.load_misses
+                << ", \"store_hits\": " << s.store_hits
+                << ", \"store_misses\": " << s.store_misses
+                << ", \"writebacks\": " << s.writebacks
+                << ", \"invalidations\": " << s.invalidations;
+        };
+        auto core_counters = [&](const LevelStats& s) {
+            counters(s);
+            out << ", \"downgrades\": " << s.downgrades
+                << ", \"cycles\": " << s.cycles
+                << ", \"acpa\": " << share(s.cycles, s.loads + s.stores);
+        };
+        out << "{\"cores\": [";
+        for (size_t core = 0; core < cores.size(); core++) {
+            out << (core ? ", " : "") << "{\"trace\": \"" << names[core] << "\", ";
+            core_counters(cores[core].stats);
+            out << "}";
+        }
+        out << "], \"all_cores\": {";
+        core_counters(all);
+        out << "}, \"l1\": \"" << formatCacheConfig(private_level.cache) << "\""
+            << ", \"llc\": {\"config\": \"" << formatCacheConfig(shared_level.cache) << "\", ";
+        counters(llc_stats);
+        out << "}, \"coherence\": " << (options.coherence ? "true" : "false")
+            << ", \"memory_reads\": " << memory_reads
+            << ", \"memory_writes\": " << memory_writes
+            << ", \"total_cycles\": " << all.cycles
+            << ", \"acpa\": " << share(all.cycles, all.loads + all.stores) << "}" << std::endl;
+        return;
+    }
+
+    auto print = [&](const LevelStats& s, bool core) {
+        uint64_t requests = s.loads + s.stores;
+        out << "Total loads: " << s.loads << std::endl;
+        out << "Total stores: " << s.stores << std::endl;
+        out << "Load hits: " << s.load_hits << std::endl;
+        out << "Load misses: " << s.load_misses << std::endl;
+        out << "Store hits: " << s.store_hits << std::endl;
+        out << "Store misses: " << s.store_misses << std::endl;
+        out << "Writebacks: " << s.writebacks << std::endl;
+        if (core && options.coherence) {
+            out << "Coherence invalidations: " << s.invalidations << std::endl;
+            out << "Coherence downgrades: " << s.downgrades << std::endl;
+        } else if (!core && shared_level.inclusion == INCLUSION_INCLUSIVE) {
+            out << "Back invalidations: " << s.invalidations << std::endl;
+        }
+        if (core) {
+            out << "Cycles: " << s.cycles << std::endl;
+        }
+        if (output.metrics) {
+            out << "Hit rate: " << share(s.load_hits + s.store_hits, requests) << std::endl;
+            out << "Miss rate: " << share(s.load_misses + s.store_misses, requests) << std::endl;
+            if (core) {
+                out << "Average cycles per access: " << share(s.cycles, requests) << std::endl;
+            }
+        }
+        out << std::endl;
+    };
+
+    for (size_t core = 0; core < cores.size(); core++) {
+        out << "Core " << core << " (" << names[core] << "): " << formatCacheConfig(private_level.cache)
+            << std::endl;
+        print(cores[core].stats, true);
+    }
+    out << "All cores:" << std::endl;
+    print(all, true);
+    out << "LLC: " << formatCacheConfig(shared_level.cache) << std::endl;
+    print(llc_stats, false);
+    out << "Memory reads: " << memory_reads << std::endl;
+    out << "Memory writes: " << memory_writes << std::endl;
+    out << "Total cycles: " << all.cycles << std::endl;
+}
@@ -0,0 +1,109 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "hierarchy.h"
+#include "report.h"
+
+// the order the cores' traces are merged in
+enum InterleaveOrder {
+    // quantum accesses from each core in turn
+    INTERLEAVE_ROUND_ROBIN,
+    // the core whose own cycle count is furthest behind goes next, the
+    // traces carry no timestamps so each core's clock stands in for them
+    INTERLEAVE_CYCLES
+};
+
+bool parseInterleave(const std::string& name, InterleaveOrder& order);
+
+struct MulticoreOptions {
+    InterleaveOrder order = INTERLEAVE_ROUND_ROBIN;
+    uint64_t quantum = 1;
+    // keep the private caches coherent with msi write-invalidate: a store
+    // removes every other core's copy, and a miss on a block another core
+    // holds modified has that core write it back and keep it shared
+    bool coherence = false;
+    // the traces are threads of one program, so an address means the same
+    // data on every core. otherwise each core has an address space of its
+    // own, told apart by the core number above the address bits
+    bool shared_memory = false;
+};
+
+// the two lines of a --hierarchy file, the private L1 every core gets a copy
+// of and the shared last level cache, which may not be exclusive
+bool readMulticoreFile(const std::string& path, std::vector<LevelConfig>& levels, std::ostream& err);
+
+// cores with one trace and one private L1 each, over a shared last level
+// cache in front of memory. the levels work as in CacheHierarchy, and each
+// core pays for what its own accesses cause
+class MulticoreSystem {
+private:
+    struct LevelStats {
+        uint64_t loads;
+        uint64_t stores;
+        uint64_t load_hits;
+        uint64_t load_misses;
+        uint64_t store_hits;
+        uint64_t store_misses;
+        uint64_t writebacks;
+        // copies removed: from a core's L1 by the other cores' stores, from
+        // above the LLC when it is inclusive
+        uint64_t invalidations;
+        // modified copies written back for another core's access
+        uint64_t downgrades;
+        uint64_t cycles;
+    };
+
+    struct Core {
+        std::unique_ptr<Cache> l1;
+        LevelStats stats;
+    };
+
+    LevelConfig private_level;
+    LevelConfig shared_level;
+    MulticoreOptions options;
+    LatencyModel latency;
+    std::vector<Core> cores;
+    std::unique_ptr<Cache> llc;
+    LevelStats llc_stats;
+    uint64_t memory_reads;
+    uint64_t memory_writes;
+    // where the core number goes in a private address space, 0 when the
+    // cores share memory
+    int core_shift;
+    Address address_mask;
+
+    static void count(LevelStats& stats, char operation, bool hit);
+    // what the other cores do before core's access under msi
+    void snoop(size_t core, char operation, Address block);
+    // the L1 of core reading or writing bytes at address in the LLC
+    void readShared(size_t core, Address address, int bytes);
+    void writeShared(size_t core, Address address, int bytes);
+    void handleShared(size_t core, char operation, int bytes, const AccessResult& result);
+    void memoryAccess(size_t core, bool store, int bytes);
+
+public:
+    // latency sets the memory costs, each level's hit cost is its hit_latency
+    MulticoreSystem(const LevelConfig& private_level, const LevelConfig& shared_level, size_t cores,
+                    const LatencyModel& latency, const MulticoreOptions& options);
+
+    // the bits the core number needs above the addresses of the traces
+    static int coreBits(size_t cores);
+
+    void processAccess(size_t core, char operation, Address address);
+    // interleaves the traces, one per core, in options.order. the first
+    // warmup accesses of the merged stream are left out of the counters
+    void run(const std::vector<std::vector<Access>>& traces, uint64_t warmup = 0);
+    // zeroes every counter but keeps the contents of the caches
+    void resetStats();
+    // text or json, per core then every core together and the LLC. names
+    // label the cores, metrics adds rates and the average cycles per access
+    void printStats(const std::vector<std::string>& names, std::ostream& out = std::cout,
+                    const OutputOptions& output = OutputOptions()) const;
+};
+
+#endif
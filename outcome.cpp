@@ -0,0 +1,238 @@
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "outcome.h"
+
+static const char OUTCOME_MAGIC[8] = {'C', 'S', 'I', 'M', 'O', 'U', 'T', 'C'};
+static const uint32_t OUTCOME_VERSION = 1;
+
+// what the outcomes were recorded from, a log only reads back for the same
+struct OutcomeHeader {
+    uint32_t version;
+    uint32_t sets;
+    uint32_t blocks_per_set;
+    uint32_t block_size;
+    uint32_t policy;
+    uint32_t write_allocate;
+    uint32_t address_bits;
+    uint32_t split_accesses;
+    uint64_t trace_hash;
+    uint64_t accesses;
+};
+
+static OutcomeHeader outcomeHeader(uint64_t trace_hash, const CacheConfig& config, uint64_t accesses) {
+    OutcomeHeader header = OutcomeHeader();
+    header.version = OUTCOME_VERSION;
+    header.sets = config.num_sets;
+    header.blocks_per_set = config.num_blocks;
+    header.block_size = config.block_size;
+    header.policy = config.policy;
+    header.write_allocate = config.write_allocate;
+    header.address_bits = config.address_bits;
+    header.split_accesses = config.split_accesses;
+    header.trace_hash = trace_hash;
+    header.accesses = accesses;
+    return header;
+}
+
+bool OutcomeLog::write(std::ostream& out, uint64_t trace_hash, const CacheConfig& config) const {
+    CheckpointWriter writer(out);
+    writer.bytes(OUTCOME_MAGIC, sizeof(OUTCOME_MAGIC));
+    writer(outcomeHeader(trace_hash, config, count));
+    writer(bits);
+    return writer.ok();
+}
+
+bool OutcomeLog::read(std::istream& in, uint64_t trace_hash, const CacheConfig& config) {
+    CheckpointReader reader(in);
+    char magic[sizeof(OUTCOME_MAGIC)];
+    reader.bytes(magic, sizeof(magic));
+    OutcomeHeader header;
+    reader(header);
+    if (!reader.ok() || std::memcmp(magic, OUTCOME_MAGIC, sizeof(magic)) != 0) {
+        return false;
+    }
+    // accesses is only known from the header itself
+    OutcomeHeader expected = outcomeHeader(trace_hash, config, header.accesses);
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+        return false;
+    }
+    count = header.accesses;
+    bits.resize((count + 3) / 4);
+    reader(bits);
+    return reader.ok();
+}
+
+// splitmix64's finaliser
+static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t hashTrace(const std::vector<Access>& trace) {
+    uint64_t hash = trace.size();
+    for (const Access& access : trace) {
+        hash = mix(hash ^ access.address);
+        hash = mix(hash ^ (uint64_t(uint8_t(access.operation)) << 8 | access.size));
+    }
+    return hash;
+}
+
+std::string outcomeLogName(uint64_t trace_hash, const CacheConfig& config) {
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(trace_hash));
+    return std::string(hash) + "-" + std::to_string(config.num_sets) + "-" + std::to_string(config.num_blocks)
+        + "-" + std::to_string(config.block_size) + "-"
+        + (config.write_allocate ? "write-allocate" : "no-write-allocate") + "-" + policyName(config.policy)
+        + "-" + std::to_string(config.address_bits) + (config.split_accesses ? "-split" : "") + ".outcomes";
+}
+
+OutcomeLog recordOutcomes(const std::vector<Access>& trace, const CacheConfig& config) {
+    // write-back keeps the dirty bits the writeback outcomes need, and
+    // write-allocate caches hit and miss the same either way
+    CacheConfig simulated = config;
+    simulated.write_through = !config.write_allocate;
+    simulated.write_buffer = 0;
+    std::unique_ptr<Cache> cache = makeCache(simulated);
+
+    OutcomeLog log;
+    int block_bits = std::log2(config.block_size);
+    for (const Access& access : trace) {
+        auto record = [&](Address address) {
+            AccessResult result = cache->access(access.operation, address);
+            log.add(result.hit, result.writeback);
+        };
+        if (config.split_accesses) {
+            forEachBlock(access.address, access.size, block_bits, record);
+        } else {
+            record(access.address);
+        }
+    }
+    return log;
+}
+
+bool cachedOutcomes(const std::string& directory, const std::vector<Access>& trace, uint64_t trace_hash,
+                    const CacheConfig& config, OutcomeLog& log, std::ostream& err) {
+    std::string path = directory + "/" + outcomeLogName(trace_hash, config);
+    std::ifstream in(path, std::ios::binary);
+    if (in && log.read(in, trace_hash, config)) {
+        return true;
+    }
+
+    log = recordOutcomes(trace, config);
+    // written under a name of its own and renamed into place, so a reader
+    // never sees half a log however many runs share the directory
+    static std::atomic<unsigned int> writes(0);
+    std::string temporary = path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(writes++);
+    mkdir(directory.c_str(), 0777);
+    std::ofstream out(temporary, std::ios::binary);
+    if (!log.write(out, trace_hash, config) || !out.flush() || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        err << "could not write outcome log " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CacheStats replayOutcomes(const std::vector<Access>& trace, const OutcomeLog& log, const CacheConfig& config,
+                          uint64_t warmup) {
+    const LatencyModel& latency = config.latency;
+    uint64_t miss_cycles = latency.missCycles(config.block_size);
+    uint64_t writeback_cycles = config.write_through ? 0 : latency.writebackCycles(config.block_size);
+    uint64_t store_through_cycles = latency.storeThroughCycles();
+    WriteBuffer write_buffer(config.write_through ? config.write_buffer : 0, config.block_size,
+                             latency.memory_latency, latency.word_cycles);
+    int block_bits = std::log2(config.block_size);
+
+    // the same charges, in the same order, as CacheSimulator's
+    CacheStats stats;
+    auto storeThrough = [&](Address address) {
+        if (!write_buffer.enabled()) {
+            stats.total_cycles += store_through_cycles;
+            return;
+        }
+        WriteBuffer::Result result = write_buffer.store(address, stats.total_cycles);
+        if (result.merged) {
+            stats.write_buffer_merges++;
+        } else {
+            stats.write_buffer_transactions++;
+        }
+        stats.total_cycles += result.wait;
+        stats.write_buffer_stall_cycles += result.wait;
+    };
+
+    auto memoryTransfer = [&](uint64_t cycles) {
+        if (write_buffer.enabled()) {
+            uint64_t wait = write_buffer.transfer(stats.total_cycles, cycles);
+            stats.total_cycles += wait;
+            stats.write_buffer_stall_cycles += wait;
+        }
+        stats.total_cycles += cycles;
+    };
+    auto fill = [&](bool writeback) {
+        memoryTransfer(miss_cycles);
+        if (writeback && writeback_cycles) {
+            memoryTransfer(writeback_cycles);
+        }
+    };
+
+    size_t next = 0;
+    auto replay = [&](char operation, Address address) {
+        bool hit = log.hit(next);
+        bool writeback = log.writeback(next);
+        next++;
+        stats.address_mask |= address;
+        stats.total_cycles += latency.hit_cycles;
+
+        if (operation == 'l') {
+            stats.total_loads++;
+            if (hit) {
+                stats.load_hits++;
+            } else {
+                stats.load_misses++;
+                fill(writeback);
+            }
+            return;
+        }
+        stats.total_stores++;
+        if (hit) {
+            stats.store_hits++;
+        } else {
+            stats.store_misses++;
+            if (config.write_allocate) {
+                fill(writeback);
+            }
+        }
+        if (config.write_through) {
+            storeThrough(address);
+        }
+    };
+
+    for (size_t i = 0; i < trace.size(); i++) {
+        if (i == warmup && warmup > 0) {
+            write_buffer.restartClock(stats.total_cycles);
+            Address mask = stats.address_mask;
+            stats = CacheStats();
+            stats.address_mask = mask;
+        }
+        const Access& access = trace[i];
+        if (!config.split_accesses) {
+            replay(access.operation, access.address);
+        } else if (forEachBlock(access.address, access.size, block_bits,
+                                [&](Address address) { replay(access.operation, address); })) {
+            stats.split_accesses++;
+        }
+    }
+    if (trace.size() <= warmup) {
+        Address mask = stats.address_mask;
+        stats = CacheStats();
+        stats.address_mask = mask;
+    }
+    return stats;
+}
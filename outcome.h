@@ -0,0 +1,64 @@
+#ifndef OUTCOME_H
+#define OUTCOME_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "cache.h"
+
+// what every access of a trace did in one geometry with one replacement
+// policy: whether it hit, and whether the block it replaced would have been
+// dirty with write-back. neither depends on the write-hit policy or the
+// latencies, so one log gives the counters of write-through and write-back
+// and of any latency model without simulating the sets again.
+// no-write-allocate changes which misses fill, so it needs a log of its own
+class OutcomeLog {
+private:
+    // 2 bits per access, 4 accesses per byte: hit, then writeback
+    std::vector<uint8_t> bits;
+    uint64_t count;
+
+public:
+    OutcomeLog() : count(0) {}
+
+    void add(bool hit, bool writeback) {
+        if (count % 4 == 0) {
+            bits.push_back(0);
+        }
+        bits.back() |= (hit | (writeback << 1)) << (count % 4 * 2);
+        count++;
+    }
+    size_t size() const { return count; }
+    bool hit(size_t i) const { return bits[i / 4] >> (i % 4 * 2) & 1; }
+    bool writeback(size_t i) const { return bits[i / 4] >> (i % 4 * 2) & 2; }
+
+    // the log with a header saying which trace and cache it belongs to
+    bool write(std::ostream& out, uint64_t trace_hash, const CacheConfig& config) const;
+    // false unless in holds the log of exactly this trace and cache
+    bool read(std::istream& in, uint64_t trace_hash, const CacheConfig& config);
+};
+
+// a hash of every record of a trace, the part of an outcome log's key that
+// says which trace it is
+uint64_t hashTrace(const std::vector<Access>& trace);
+
+// the file name of the outcome log of a trace and cache: the trace hash and
+// everything about the cache the outcomes depend on
+std::string outcomeLogName(uint64_t trace_hash, const CacheConfig& config);
+
+// simulates trace once on config's geometry, policy and write allocation
+OutcomeLog recordOutcomes(const std::vector<Access>& trace, const CacheConfig& config);
+
+// the log of trace and config from directory, or recorded and saved there
+// when it has none yet. false, with the reason in err, if it cannot be saved
+bool cachedOutcomes(const std::string& directory, const std::vector<Access>& trace, uint64_t trace_hash,
+                    const CacheConfig& config, OutcomeLog& log, std::ostream& err);
+
+// the counters a CacheSimulator for config would end with on trace, from
+// its outcome log alone. the first warmup records are left out, as with
+// Cache::resetStats()
+CacheStats replayOutcomes(const std::vector<Access>& trace, const OutcomeLog& log, const CacheConfig& config,
+                          uint64_t warmup = 0);
+
+#endif
@@ -0,0 +1,119 @@
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "parallel.h"
+
+bool readConfigFile(const std::string& path, std::vector<CacheConfig>& configs, std::ostream& err) {
+    std::ifstream in(path);
+    if (!in) {
+        err << "could not open config file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        std::istringstream words(line);
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word) {
+            args.push_back(word);
+        }
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+
+        CacheConfig config;
+        if (!parseCacheConfig(args, config, err)) {
+            err << path << ":" << line_number << ": invalid cache configuration" << std::endl;
+            return false;
+        }
+        configs.push_back(config);
+    }
+    return true;
+}
+
+int defaultThreadCount() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+void runConfigs(const std::vector<Access>& trace, const std::vector<CacheConfig>& configs,
+                int threads, const OutputOptions& output, std::ostream& out, uint64_t warmup) {
+    size_t warm = std::min<uint64_t>(warmup, trace.size());
+    std::vector<std::string> results(configs.size());
+    std::atomic<size_t> next(0);
+
+    // each worker pulls the next unclaimed config until none are left
+    auto worker = [&]() {
+        for (size_t i = next++; i < configs.size(); i = next++) {
+            std::unique_ptr<Cache> cache = makeCache(configs[i]);
+            if (warm > 0) {
+                cache->processTrace(trace.data(), warm);
+                cache->resetStats();
+            }
+            cache->processTrace(trace.data() + warm, trace.size() - warm);
+            std::ostringstream report;
+            printReport(configs[i], cache->getStats(), output, true, report);
+            if (output.format == FORMAT_TEXT) {
+                report << std::endl;
+            }
+            results[i] = report.str();
+        }
+    };
+
+    size_t workers = std::min<size_t>(std::max(threads, 1), configs.size());
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : pool) {
+        t.join();
+    }
+
+    if (output.format == FORMAT_CSV) {
+        printCsvHeader(out);
+    }
+    for (const std::string& result : results) {
+        out << result;
+    }
+}
+
+CacheStats runPartitioned(const std::vector<Access>& trace, const CacheConfig& config, int threads,
+                          uint64_t warmup) {
+    size_t warm = std::min<uint64_t>(warmup, trace.size());
+    int shards = std::min(std::max(threads, 1), config.num_sets);
+    std::vector<CacheStats> results(shards);
+
+    auto worker = [&](int shard) {
+        // spread the remainder so shard sizes differ by at most one set
+        unsigned int first = (long long)config.num_sets * shard / shards;
+        unsigned int last = (long long)config.num_sets * (shard + 1) / shards;
+        std::unique_ptr<Cache> cache = makeCache(config);
+        cache->setShard(first, last - first);
+        if (warm > 0) {
+            cache->processShardTrace(trace.data(), warm);
+            cache->resetStats();
+        }
+        cache->processShardTrace(trace.data() + warm, trace.size() - warm);
+        results[shard] = cache->getStats();
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < shards; i++) {
+        pool.emplace_back(worker, i);
+    }
+    worker(0);
+    for (std::thread& t : pool) {
+        t.join();
+    }
+
+    CacheStats total;
+    for (const CacheStats& stats : results) {
+        total += stats;
+    }
+    return total;
+}
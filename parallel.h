@@ -0,0 +1,30 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "report.h"
+#include "trace.h"
+
+// one config per line in the same form as the command line arguments,
+// blank lines and lines starting with # are skipped
+bool readConfigFile(const std::string& path, std::vector<CacheConfig>& configs, std::ostream& err);
+
+// number of workers to use when none is asked for
+int defaultThreadCount();
+
+// simulates every config over the shared, read-only trace on a pool of
+// threads workers and prints one report per config, in config order. the
+// first warmup accesses are simulated but left out of the counters
+void runConfigs(const std::vector<Access>& trace, const std::vector<CacheConfig>& configs,
+                int threads, const OutputOptions& output, std::ostream& out, uint64_t warmup = 0);
+
+// simulates a single config with its sets split into contiguous ranges, one
+// per worker. every worker scans the whole trace but only touches its own
+// sets, and the counters are summed at the end
+CacheStats runPartitioned(const std::vector<Access>& trace, const CacheConfig& config, int threads,
+                          uint64_t warmup = 0);
+
+#endif
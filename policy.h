@@ -0,0 +1,305 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// replacement policies for CacheSimulator. each one keeps whatever per-way
+// state it needs and provides
+//   onHit(set, way)   a resident block was accessed
+//   onFill(set, way)  a block was installed, into an empty or victim way
+//   victim(set)       the way to evict from a full set
+//   onInvalidate(set, way)  a block was removed without being replaced
+//   checkpoint(archive)     hands all of its state to a checkpoint archive
+// and names itself in KIND. CacheSimulator is templated on the policy so
+// these inline into the access loop. ways is always a power of 2
+
+enum ReplacementPolicy {
+    POLICY_LRU,
+    POLICY_FIFO,
+    POLICY_RANDOM,
+    POLICY_PLRU,
+    POLICY_SRRIP,
+    POLICY_BRRIP,
+    POLICY_LFU
+};
+
+// intrusive doubly linked recency list per set, constant time everywhere
+class LruPolicy {
+private:
+    int ways;
+    // neighbouring way + 1 toward the head (most recent) and tail, 0 for none
+    std::vector<uint32_t> prev;
+    std::vector<uint32_t> next;
+    // way + 1 at each end of each set's list, 0 while the set is empty
+    std::vector<uint32_t> head;
+    std::vector<uint32_t> tail;
+
+    void pushFront(size_t set, uint32_t* p, uint32_t* n, int way) {
+        p[way] = 0;
+        n[way] = head[set];
+        if (head[set]) {
+            p[head[set] - 1] = way + 1;
+        } else {
+            tail[set] = way + 1;
+        }
+        head[set] = way + 1;
+    }
+
+public:
+    static constexpr ReplacementPolicy KIND = POLICY_LRU;
+
+    LruPolicy(size_t sets, int ways)
+        : ways(ways), prev(sets * ways, 0), next(sets * ways, 0), head(sets, 0), tail(sets, 0) {}
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(prev);
+        archive(next);
+        archive(head);
+        archive(tail);
+    }
+
+    void onHit(size_t set, int way) {
+        if (head[set] == uint32_t(way + 1)) {
+            return;
+        }
+        uint32_t* p = &prev[set * ways];
+        uint32_t* n = &next[set * ways];
+        // unlink, way is not the head so it has a prev
+        n[p[way] - 1] = n[way];
+        if (n[way]) {
+            p[n[way] - 1] = p[way];
+        } else {
+            tail[set] = p[way];
+        }
+        pushFront(set, p, n, way);
+    }
+
+    void onFill(size_t set, int way) {
+        if (head[set] == uint32_t(way + 1) || prev[set * ways + way]) {
+            // refilling the victim, it is already linked
+            onHit(set, way);
+        } else {
+            pushFront(set, &prev[set * ways], &next[set * ways], way);
+        }
+    }
+
+    int victim(size_t set) const { return tail[set] - 1; }
+
+    void onInvalidate(size_t set, int way) {
+        uint32_t* p = &prev[set * ways];
+        uint32_t* n = &next[set * ways];
+        if (p[way]) {
+            n[p[way] - 1] = n[way];
+        } else {
+            head[set] = n[way];
+        }
+        if (n[way]) {
+            p[n[way] - 1] = p[way];
+        } else {
+            tail[set] = p[way];
+        }
+        p[way] = 0;
+        n[way] = 0;
+    }
+};
+
+// ways are filled in order, so evicting round robin is first in first out.
+// a way refilled after an invalidation keeps its old place in the rotation
+class FifoPolicy {
+private:
+    int ways;
+    std::vector<uint32_t> next_victim;
+
+public:
+    static constexpr ReplacementPolicy KIND = POLICY_FIFO;
+
+    FifoPolicy(size_t sets, int ways) : ways(ways), next_victim(sets, 0) {}
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(next_victim);
+    }
+
+    void onHit(size_t, int) {}
+    void onFill(size_t, int) {}
+    void onInvalidate(size_t, int) {}
+
+    int victim(size_t set) {
+        int way = next_victim[set];
+        next_victim[set] = (way + 1) & (ways - 1);
+        return way;
+    }
+};
+
+// xorshift with a fixed seed so runs are repeatable
+class RandomPolicy {
+private:
+    int ways;
+    uint32_t rng;
+
+public:
+    static constexpr ReplacementPolicy KIND = POLICY_RANDOM;
+
+    RandomPolicy(size_t, int ways) : ways(ways), rng(2463534242u) {}
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(rng);
+    }
+
+    void onHit(size_t, int) {}
+    void onFill(size_t, int) {}
+    void onInvalidate(size_t, int) {}
+
+    int victim(size_t) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng & (ways - 1);
+    }
+};
+
+// binary tree of ways - 1 direction bits per set, each pointing away from the
+// more recently used half
+class TreePlruPolicy {
+private:
+    int ways;
+    int levels;
+    // node i has children 2i and 2i + 1, index 0 unused
+    std::vector<unsigned char> tree;
+
+public:
+    static constexpr ReplacementPolicy KIND = POLICY_PLRU;
+
+    TreePlruPolicy(size_t sets, int ways) : ways(ways), levels(0), tree(sets * ways, 0) {
+        while ((1 << levels) < ways) {
+            levels++;
+        }
+    }
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(tree);
+    }
+
+    void onHit(size_t set, int way) {
+        unsigned char* t = &tree[set * ways];
+        int node = 1;
+        for (int level = levels - 1; level >= 0; level--) {
+            int bit = (way >> level) & 1;
+            t[node] = !bit;
+            node = 2 * node + bit;
+        }
+    }
+
+    void onFill(size_t set, int way) { onHit(set, way); }
+    void onInvalidate(size_t, int) {}
+
+    int victim(size_t set) const {
+        const unsigned char* t = &tree[set * ways];
+        int node = 1;
+        int way = 0;
+        for (int level = 0; level < levels; level++) {
+            int bit = t[node];
+            way = 2 * way + bit;
+            node = 2 * node + bit;
+        }
+        return way;
+    }
+};
+
+// 2 bit re-reference interval prediction (jaleel et al.). hits predict near
+// reuse, fills predict long (srrip) or mostly distant (brrip) reuse
+template <bool Bimodal>
+class RripPolicy {
+private:
+    static constexpr unsigned char DISTANT = 3;
+    static constexpr unsigned char LONG = 2;
+    // brrip inserts at LONG once every this many fills
+    static constexpr unsigned int BIMODAL_PERIOD = 32;
+
+    int ways;
+    std::vector<unsigned char> rrpv;
+    unsigned int fills;
+
+public:
+    static constexpr ReplacementPolicy KIND = Bimodal ? POLICY_BRRIP : POLICY_SRRIP;
+
+    RripPolicy(size_t sets, int ways) : ways(ways), rrpv(sets * ways, DISTANT), fills(0) {}
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(rrpv);
+        archive(fills);
+    }
+
+    void onHit(size_t set, int way) { rrpv[set * ways + way] = 0; }
+
+    void onFill(size_t set, int way) {
+        unsigned char insert = LONG;
+        if (Bimodal) {
+            insert = (++fills % BIMODAL_PERIOD == 0) ? LONG : DISTANT;
+        }
+        rrpv[set * ways + way] = insert;
+    }
+
+    void onInvalidate(size_t set, int way) { rrpv[set * ways + way] = DISTANT; }
+
+    // first way predicted distant, ageing the whole set until one is
+    int victim(size_t set) {
+        unsigned char* r = &rrpv[set * ways];
+        int way = 0;
+        for (int i = 1; i < ways; i++) {
+            if (r[i] > r[way]) {
+                way = i;
+            }
+        }
+        unsigned char age = DISTANT - r[way];
+        if (age) {
+            for (int i = 0; i < ways; i++) {
+                r[i] += age;
+            }
+        }
+        return way;
+    }
+};
+
+typedef RripPolicy<false> SrripPolicy;
+typedef RripPolicy<true> BrripPolicy;
+
+// least frequently used since fill, ties go to the lowest way
+class LfuPolicy {
+private:
+    int ways;
+    std::vector<uint32_t> counts;
+
+public:
+    static constexpr ReplacementPolicy KIND = POLICY_LFU;
+
+    LfuPolicy(size_t sets, int ways) : ways(ways), counts(sets * ways, 0) {}
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(counts);
+    }
+
+    void onHit(size_t set, int way) { counts[set * ways + way]++; }
+    void onFill(size_t set, int way) { counts[set * ways + way] = 1; }
+    void onInvalidate(size_t set, int way) { counts[set * ways + way] = 0; }
+
+    int victim(size_t set) const {
+        const uint32_t* c = &counts[set * ways];
+        int way = 0;
+        for (int i = 1; i < ways; i++) {
+            if (c[i] < c[way]) {
+                way = i;
+            }
+        }
+        return way;
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+#include "prefetch.h"
+
+static const char* const PREFETCHER_NAMES[] = {"none", "next-line", "stream", "tagged"};
+
+const char* prefetcherName(PrefetchKind kind) {
+    return PREFETCHER_NAMES[kind];
+}
+
+bool parsePrefetcher(const std::string& name, PrefetchKind& kind) {
+    for (size_t i = 0; i < sizeof(PREFETCHER_NAMES) / sizeof(PREFETCHER_NAMES[0]); i++) {
+        if (name == PREFETCHER_NAMES[i]) {
+            kind = static_cast<PrefetchKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+StreamDetector::StreamDetector() : streams(STREAMS, Stream()), clock(0) {}
+
+int64_t StreamDetector::train(uint64_t block) {
+    clock++;
+    Stream* nearest = nullptr;
+    int64_t nearest_step = 0;
+    for (Stream& stream : streams) {
+        int64_t step = int64_t(block - stream.last);
+        if (stream.used && step != 0 && std::llabs(step) <= WINDOW
+            && (!nearest || std::llabs(step) < std::llabs(nearest_step))) {
+            nearest = &stream;
+            nearest_step = step;
+        }
+    }
+
+    if (!nearest) {
+        Stream* oldest = &streams[0];
+        for (Stream& stream : streams) {
+            if (stream.used < oldest->used) {
+                oldest = &stream;
+            }
+        }
+        *oldest = Stream{block, 0, 0, clock};
+        return 0;
+    }
+
+    if (nearest_step == nearest->stride) {
+        nearest->confidence = std::min(nearest->confidence + 1, 3);
+    } else {
+        nearest->stride = nearest_step;
+        nearest->confidence = 0;
+    }
+    nearest->last = block;
+    nearest->used = clock;
+    return nearest->confidence > 0 ? nearest->stride : 0;
+}
+
+PrefetchingCache::PrefetchingCache(std::unique_ptr<Cache> cache, const CacheConfig& config)
+    : cache(std::move(cache)), prefetcher(config.prefetch), block_bits(std::log2(config.block_size)),
+      fill_cycles(config.latency.missCycles(config.block_size)), split_accesses(config.split_accesses),
+      split_records(0), prefetches(0), useful_prefetches(0), late_prefetches(0), useless_prefetches(0),
+      stall_cycles(0) {
+    uint64_t address_mask = config.address_bits < 64 ? (uint64_t(1) << config.address_bits) - 1 : ~uint64_t(0);
+    block_mask = address_mask >> block_bits;
+}
+
+void PrefetchingCache::processBatch(const Access* accesses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char operation = accesses[i].operation;
+        if (!split_accesses) {
+            access(operation, accesses[i].address);
+        } else if (forEachBlock(accesses[i].address, accesses[i].size, block_bits,
+                                [&](Address address) { access(operation, address); })) {
+            split_records++;
+        }
+    }
+}
+
+AccessResult PrefetchingCache::access(char operation, Address address) {
+    uint64_t block = address >> block_bits;
+    AccessResult result = cache->access(operation, address);
+    if (result.evicted) {
+        dropped(result.victim >> block_bits);
+    }
+
+    bool first_use = false;
+    if (result.hit) {
+        uint32_t* slot = pending.find(block);
+        if (slot) {
+            useful_prefetches++;
+            uint64_t arrival = ready[*slot];
+            uint64_t cycle = now();
+            if (arrival > cycle) {
+                late_prefetches++;
+                stall_cycles += arrival - cycle;
+            }
+            release(block, *slot);
+            first_use = true;
+        }
+    }
+
+    if (!result.hit || (first_use && prefetcher.kind != PREFETCH_NEXT_LINE)) {
+        fire(block);
+    }
+    return result;
+}
+
+void PrefetchingCache::fire(uint64_t block) {
+    int64_t stride = 1;
+    if (prefetcher.kind == PREFETCH_STREAM) {
+        stride = streams.train(block);
+        if (stride == 0) {
+            return;
+        }
+    }
+    for (unsigned int i = 1; i <= prefetcher.degree; i++) {
+        issue(block + uint64_t(stride) * i);
+    }
+}
+
+void PrefetchingCache::issue(uint64_t block) {
+    block &= block_mask;
+    AccessResult result = cache->prefetch(Address(block) << block_bits);
+    if (result.hit) {
+        return;
+    }
+    if (result.evicted) {
+        dropped(result.victim >> block_bits);
+    }
+    prefetches++;
+
+    uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = ready.size();
+        ready.push_back(0);
+    }
+    ready[slot] = now() + fill_cycles;
+    pending.insert(block, slot);
+}
+
+void PrefetchingCache::dropped(uint64_t block) {
+    uint32_t* slot = pending.find(block);
+    if (slot) {
+        useless_prefetches++;
+        release(block, *slot);
+    }
+}
+
+void PrefetchingCache::release(uint64_t block, uint32_t slot) {
+    free_slots.push_back(slot);
+    pending.erase(block);
+}
+
+bool PrefetchingCache::invalidate(Address address, bool& dirty) {
+    if (!cache->invalidate(address, dirty)) {
+        return false;
+    }
+    dropped(address >> block_bits);
+    return true;
+}
+
+const CacheStats& PrefetchingCache::getStats() const {
+    stats = cache->getStats();
+    stats.total_cycles += stall_cycles;
+    stats.split_accesses += split_records;
+    stats.prefetches = prefetches;
+    stats.useful_prefetches = useful_prefetches;
+    stats.late_prefetches = late_prefetches;
+    stats.useless_prefetches = useless_prefetches;
+    stats.prefetch_cycles = prefetches * fill_cycles;
+    return stats;
+}
+
+void PrefetchingCache::resetStats() {
+    cache->resetStats();
+    split_records = 0;
+    prefetches = 0;
+    useful_prefetches = 0;
+    late_prefetches = 0;
+    useless_prefetches = 0;
+    stall_cycles = 0;
+    pending = BlockTable();
+    ready.clear();
+    free_slots.clear();
+}
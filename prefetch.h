@@ -0,0 +1,117 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "classify.h"
+
+// command line name of a prefetcher, and back
+const char* prefetcherName(PrefetchKind kind);
+bool parsePrefetcher(const std::string& name, PrefetchKind& kind);
+
+// finds strides in a stream of block numbers without pcs: each block joins
+// the tracked stream whose last block is nearest, within WINDOW blocks, and
+// a stream's stride counts once two steps in a row have had it. the least
+// recently extended stream makes way for a block near none of them
+class StreamDetector {
+public:
+    static const int STREAMS = 16;
+    static const int64_t WINDOW = 64;
+
+private:
+    struct Stream {
+        uint64_t last;
+        int64_t stride;
+        int confidence;
+        uint64_t used;
+    };
+
+    std::vector<Stream> streams;
+    uint64_t clock;
+
+public:
+    StreamDetector();
+
+    // adds block to its stream, returning the confirmed stride to prefetch
+    // along from it or 0 if there is none yet
+    int64_t train(uint64_t block);
+};
+
+// a cache with a prefetcher in front of it. demand accesses go through
+// access() one at a time and each miss, and for tagged and stream each first
+// hit to a prefetched block, fires the prefetcher. its fills take the memory
+// latency of a miss from the cycle they are issued at, a demand access that
+// comes sooner waits out the rest and counts the prefetch as late.
+// the plain CacheSimulator loop never sees any of this, makeCache() only
+// wraps a cache when a prefetcher is configured
+class PrefetchingCache : public Cache {
+private:
+    std::unique_ptr<Cache> cache;
+    PrefetchConfig prefetcher;
+    int block_bits;
+    // block numbers past the configured address width wrap around
+    uint64_t block_mask;
+    uint64_t fill_cycles;
+    bool split_accesses;
+    uint64_t split_records;
+
+    // the prefetched blocks no demand access has used yet, to the cycle each
+    // one arrives at in ready. freed slots of ready are reused
+    BlockTable pending;
+    std::vector<uint64_t> ready;
+    std::vector<uint32_t> free_slots;
+    StreamDetector streams;
+
+    uint64_t prefetches;
+    uint64_t useful_prefetches;
+    uint64_t late_prefetches;
+    uint64_t useless_prefetches;
+    uint64_t stall_cycles;
+    mutable CacheStats stats;
+
+    // the cycle the run has reached, demand accesses and waits
+    uint64_t now() const { return cache->getStats().total_cycles + stall_cycles; }
+    void fire(uint64_t block);
+    void issue(uint64_t block);
+    // block left the cache, unused if it is still pending
+    void dropped(uint64_t block);
+    void release(uint64_t block, uint32_t slot);
+
+public:
+    // cache must not prefetch itself, it does the simulating
+    PrefetchingCache(std::unique_ptr<Cache> cache, const CacheConfig& config);
+
+    void processTrace(const Access* accesses, size_t count) override { processBatch(accesses, count); }
+    void processBatch(const Access* accesses, size_t count) override;
+
+    AccessResult access(char operation, Address address) override;
+    bool invalidate(Address address, bool& dirty) override;
+
+    // the rest go straight to the wrapped cache, without prefetching
+    bool clean(Address address) override { return cache->clean(address); }
+    bool markDirty(Address address) override { return cache->markDirty(address); }
+    AccessResult insert(Address address, bool dirty) override { return cache->insert(address, dirty); }
+    AccessResult prefetch(Address address) override { return cache->prefetch(address); }
+    int blockSize() const override { return cache->blockSize(); }
+    void setShard(unsigned int first, unsigned int count) override { cache->setShard(first, count); }
+    void processShardTrace(const Access* accesses, size_t count) override {
+        cache->processShardTrace(accesses, count);
+    }
+
+    const CacheStats& getStats() const override;
+    // also forgets which blocks were prefetched, so every prefetch counted
+    // afterwards was issued afterwards
+    void resetStats() override;
+
+    // the pending prefetches and stream table would have to go with it
+    bool saveCheckpoint(std::ostream&) override { return false; }
+    bool loadCheckpoint(std::istream&, std::ostream& err) override {
+        err << "prefetching runs cannot be checkpointed" << std::endl;
+        return false;
+    }
+};
+
+#endif
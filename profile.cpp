@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <utility>
+#include "profile.h"
+
+static const size_t MIN_TRACKED_BLOCKS = 4096;
+
+SpaceSaving::SpaceSaving(size_t capacity) : capacity(capacity), slots(capacity) {
+    counters.reserve(capacity);
+}
+
+void SpaceSaving::swapCounters(size_t a, size_t b) {
+    std::swap(counters[a], counters[b]);
+    *slots.find(counters[a].block) = a;
+    *slots.find(counters[b].block) = b;
+}
+
+void SpaceSaving::siftUp(size_t i) {
+    while (i > 0 && counters[(i - 1) / 2].count > counters[i].count) {
+        swapCounters(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void SpaceSaving::siftDown(size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < counters.size(); child++) {
+            if (counters[child].count < counters[smallest].count) {
+                smallest = child;
+            }
+        }
+        if (smallest == i) {
+            return;
+        }
+        swapCounters(i, smallest);
+        i = smallest;
+    }
+}
+
+void SpaceSaving::add(uint64_t block) {
+    uint32_t* slot = slots.find(block);
+    if (slot) {
+        size_t i = *slot;
+        counters[i].count++;
+        siftDown(i);
+    } else if (counters.size() < capacity) {
+        counters.push_back(Counter{block, 1, 0});
+        slots.insert(block, counters.size() - 1);
+        siftUp(counters.size() - 1);
+    } else {
+        // the least counted block gives up its counter, the newcomer may
+        // have been seen up to that many times before
+        Counter& reused = counters[0];
+        slots.erase(reused.block);
+        reused.block = block;
+        reused.error = reused.count;
+        reused.count++;
+        slots.insert(block, 0);
+        siftDown(0);
+    }
+}
+
+std::vector<SpaceSaving::Counter> SpaceSaving::top() const {
+    std::vector<Counter> sorted = counters;
+    std::sort(sorted.begin(), sorted.end(), [](const Counter& a, const Counter& b) {
+        return a.count != b.count ? a.count > b.count : a.block < b.block;
+    });
+    return sorted;
+}
+
+ProfiledCache::ProfiledCache(std::unique_ptr<Cache> cache, const CacheConfig& config, size_t top_blocks)
+    : cache(std::move(cache)), block_bits(std::log2(config.block_size)), set_mask(config.num_sets - 1),
+      split_accesses(config.split_accesses), split_records(0), tracked_blocks(std::max<size_t>(top_blocks * 8, MIN_TRACKED_BLOCKS)),
+      sets(config.num_sets, SetCounters()), missing(tracked_blocks) {}
+
+AccessResult ProfiledCache::access(char operation, Address address) {
+    AccessResult result = cache->access(operation, address);
+    SetCounters& set = sets[(address >> block_bits) & set_mask];
+    if (result.hit) {
+        set.hits++;
+    } else {
+        set.misses++;
+        missing.add(address >> block_bits);
+    }
+    if (result.evicted) {
+        set.evictions++;
+    }
+    return result;
+}
+
+void ProfiledCache::processBatch(const Access* accesses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char operation = accesses[i].operation;
+        if (!split_accesses) {
+            access(operation, accesses[i].address);
+        } else if (forEachBlock(accesses[i].address, accesses[i].size, block_bits,
+                                [&](Address address) { access(operation, address); })) {
+            split_records++;
+        }
+    }
+}
+
+const CacheStats& ProfiledCache::getStats() const {
+    stats = cache->getStats();
+    stats.split_accesses += split_records;
+    return stats;
+}
+
+void ProfiledCache::resetStats() {
+    cache->resetStats();
+    split_records = 0;
+    std::fill(sets.begin(), sets.end(), SetCounters());
+    missing = SpaceSaving(tracked_blocks);
+}
+
+void printProfile(const ProfiledCache& cache, size_t top, const OutputOptions& output, std::ostream& out) {
+    const std::vector<ProfiledCache::SetCounters>& sets = cache.setCounters();
+    std::vector<unsigned int> order;
+    for (unsigned int i = 0; i < sets.size(); i++) {
+        if (sets[i].misses) {
+            order.push_back(i);
+        }
+    }
+    size_t shown = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + shown, order.end(), [&](unsigned int a, unsigned int b) {
+        return sets[a].misses != sets[b].misses ? sets[a].misses > sets[b].misses : a < b;
+    });
+    order.resize(shown);
+
+    std::vector<SpaceSaving::Counter> blocks = cache.missingBlocks();
+    blocks.resize(std::min(top, blocks.size()));
+    int block_bits = std::log2(cache.blockSize());
+
+    if (output.format == FORMAT_JSON) {
+        out << "{\"sets\": [";
+        for (size_t i = 0; i < order.size(); i++) {
+            const ProfiledCache::SetCounters& set = sets[order[i]];
+            out << (i ? ", " : "") << "{\"set\": " << order[i] << ", \"hits\": " << set.hits
+                << ", \"misses\": " << set.misses << ", \"evictions\": " << set.evictions << "}";
+        }
+        out << "], \"missing_blocks\": [";
+        for (size_t i = 0; i < blocks.size(); i++) {
+            out << (i ? ", " : "") << "{\"address\": \"0x" << std::hex << (blocks[i].block << block_bits)
+                << std::dec << "\", \"misses\": " << blocks[i].count << ", \"error\": " << blocks[i].error << "}";
+        }
+        out << "]}" << std::endl;
+        return;
+    }
+
+    out << "Sets with the most misses:" << std::endl;
+    for (unsigned int set_index : order) {
+        const ProfiledCache::SetCounters& set = sets[set_index];
+        out << "Set " << set_index << ": " << set.hits << " hits, " << set.misses << " misses, "
+            << set.evictions << " evictions" << std::endl;
+    }
+    out << "Blocks with the most misses:" << std::endl;
+    for (const SpaceSaving::Counter& block : blocks) {
+        out << "0x" << std::hex << std::setw(8) << std::setfill('0') << (block.block << block_bits) << std::dec
+            << std::setfill(' ') << ": " << block.count << " misses";
+        if (block.error) {
+            out << " (at most " << block.error << " too many)";
+        }
+        out << std::endl;
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "cache.h"
+#include "classify.h"
+#include "report.h"
+
+// the blocks seen most often, found with the space-saving algorithm (metwally
+// et al.) in a fixed number of counters however long the trace is. a count
+// is at most its error over the true count, and every block seen more than
+// total / capacity times has a counter
+class SpaceSaving {
+public:
+    struct Counter {
+        uint64_t block;
+        uint64_t count;
+        uint64_t error;
+    };
+
+private:
+    size_t capacity;
+    // a min heap on count, so the counter to reuse is always counters[0]
+    std::vector<Counter> counters;
+    // where each block's counter is in the heap
+    BlockTable slots;
+
+    void swapCounters(size_t a, size_t b);
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+
+public:
+    explicit SpaceSaving(size_t capacity);
+
+    void add(uint64_t block);
+    // every counter, highest count first
+    std::vector<Counter> top() const;
+};
+
+// a cache that counts the hits, misses and evictions of every set and the
+// blocks that miss most, for finding the sets that thrash. one virtual
+// access() call per access like ClassifiedCache, which it can wrap
+class ProfiledCache : public Cache {
+public:
+    struct SetCounters {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+private:
+    std::unique_ptr<Cache> cache;
+    int block_bits;
+    unsigned int set_mask;
+    bool split_accesses;
+    uint64_t split_records;
+    size_t tracked_blocks;
+    std::vector<SetCounters> sets;
+    SpaceSaving missing;
+    mutable CacheStats stats;
+
+public:
+    // keeps space-saving counters for 8 times top_blocks blocks, and at
+    // least 4096, so a block needs misses / 4096 misses to be sure of a place
+    ProfiledCache(std::unique_ptr<Cache> cache, const CacheConfig& config, size_t top_blocks);
+
+    void processTrace(const Access* accesses, size_t count) override { processBatch(accesses, count); }
+    void processBatch(const Access* accesses, size_t count) override;
+    AccessResult access(char operation, Address address) override;
+
+    // the rest go straight to the wrapped cache, unprofiled
+    bool invalidate(Address address, bool& dirty) override { return cache->invalidate(address, dirty); }
+    bool clean(Address address) override { return cache->clean(address); }
+    bool markDirty(Address address) override { return cache->markDirty(address); }
+    AccessResult insert(Address address, bool dirty) override { return cache->insert(address, dirty); }
+    AccessResult prefetch(Address address) override { return cache->prefetch(address); }
+    int blockSize() const override { return cache->blockSize(); }
+    void setShard(unsigned int first, unsigned int count) override { cache->setShard(first, count); }
+    void processShardTrace(const Access* accesses, size_t count) override {
+        cache->processShardTrace(accesses, count);
+    }
+
+    const CacheStats& getStats() const override;
+    void resetStats() override;
+
+    bool saveCheckpoint(std::ostream&) override { return false; }
+    bool loadCheckpoint(std::istream&, std::ostream& err) override {
+        err << "profiled runs cannot be checkpointed" << std::endl;
+        return false;
+    }
+
+    const std::vector<SetCounters>& setCounters() const { return sets; }
+    std::vector<SpaceSaving::Counter> missingBlocks() const { return missing.top(); }
+};
+
+// the top sets by misses and the top missing blocks, top of each, as text or
+// a json object on one line. goes after the printReport of the same run
+void printProfile(const ProfiledCache& cache, size_t top, const OutputOptions& output, std::ostream& out);
+
+#endif
@@ -0,0 +1,143 @@
+#include <cmath>
+#include "report.h"
+
+bool parseFormat(const std::string& name, OutputFormat& format) {
+    if (name == "text") {
+        format = FORMAT_TEXT;
+    } else if (name == "json") {
+        format = FORMAT_JSON;
+    } else if (name == "csv") {
+        format = FORMAT_CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// bits of replacement state each policy needs for one set, counting the
+// cheapest encoding of what the simulator keeps
+static uint64_t replacementBits(ReplacementPolicy policy, int ways) {
+    int way_bits = std::log2(ways);
+    switch (policy) {
+    case POLICY_LRU:
+        // a recency rank per way
+        return uint64_t(ways) * way_bits;
+    case POLICY_FIFO:
+        // the next way to replace
+        return way_bits;
+    case POLICY_RANDOM:
+        return 0;
+    case POLICY_PLRU:
+        return ways - 1;
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+        return uint64_t(ways) * 2;
+    case POLICY_LFU:
+        return uint64_t(ways) * 32;
+    }
+    return 0;
+}
+
+CacheSpace::CacheSpace(const CacheConfig& config) {
+    blocks = uint64_t(config.num_sets) * config.num_blocks;
+    data_bytes = blocks * config.block_size;
+
+    uint64_t block_bits = tagBits(config) + 1 + (config.write_through ? 0 : 1);
+    overhead_bits = blocks * block_bits + uint64_t(config.num_sets) * replacementBits(config.policy, config.num_blocks);
+}
+
+static double ratio(uint64_t part, uint64_t whole) {
+    return whole ? double(part) / whole : 0;
+}
+
+void printCsvHeader(std::ostream& out) {
+    out << "sets,blocks_per_set,block_size,write_allocate,write_through,policy,"
+        << "total_loads,total_stores,load_hits,load_misses,store_hits,store_misses,total_cycles,"
+        << "hit_rate,miss_rate,amat,acpa,blocks,data_bytes,overhead_bytes,total_bytes,split_accesses,"
+        << "sampled_accesses,miss_rate_error,compulsory_misses,capacity_misses,conflict_misses,"
+        << "prefetches,useful_prefetches,late_prefetches,useless_prefetches,prefetch_cycles,"
+        << "write_buffer_transactions,write_buffer_merges,write_buffer_stall_cycles" << std::endl;
+}
+
+void printReport(const CacheConfig& config, const CacheStats& stats, const OutputOptions& output,
+                 bool header, std::ostream& out) {
+    if (config.address_bits < 64 && stats.address_mask >> config.address_bits) {
+        std::cerr << "warning: the trace has addresses wider than " << config.address_bits
+                  << " bits, rerun with --address-bits 64" << std::endl;
+    }
+    CacheSpace space(config);
+    double hit_rate = ratio(stats.load_hits + stats.store_hits, stats.accesses());
+    double miss_rate = stats.missRate();
+    double amat = stats.amat(config.latency, config.block_size);
+    double acpa = stats.acpa();
+
+    if (output.format == FORMAT_JSON) {
+        out << "{\"sets\": " << config.num_sets
+            << ", \"blocks_per_set\": " << config.num_blocks
+            << ", \"block_size\": " << config.block_size
+            << ", \"write_allocate\": " << (config.write_allocate ? "true" : "false")
+            << ", \"write_through\": " << (config.write_through ? "true" : "false")
+            << ", \"policy\": \"" << policyName(config.policy) << "\""
+            << ", \"total_loads\": " << stats.total_loads
+            << ", \"total_stores\": " << stats.total_stores
+            << ", \"load_hits\": " << stats.load_hits
+            << ", \"load_misses\": " << stats.load_misses
+            << ", \"store_hits\": " << stats.store_hits
+            << ", \"store_misses\": " << stats.store_misses
+            << ", \"total_cycles\": " << stats.total_cycles
+            << ", \"hit_rate\": " << hit_rate
+            << ", \"miss_rate\": " << miss_rate
+            << ", \"amat\": " << amat
+            << ", \"acpa\": " << acpa
+            << ", \"blocks\": " << space.blocks
+            << ", \"data_bytes\": " << space.data_bytes
+            << ", \"overhead_bytes\": " << space.overheadBytes()
+            << ", \"total_bytes\": " << space.totalBytes()
+            << ", \"split_accesses\": " << stats.split_accesses
+            << ", \"sampled_accesses\": " << stats.sampled_accesses
+            << ", \"miss_rate_error\": " << stats.miss_rate_error
+            << ", \"compulsory_misses\": " << stats.compulsory_misses
+            << ", \"capacity_misses\": " << stats.capacity_misses
+            << ", \"conflict_misses\": " << stats.conflict_misses
+            << ", \"prefetches\": " << stats.prefetches
+            << ", \"useful_prefetches\": " << stats.useful_prefetches
+            << ", \"late_prefetches\": " << stats.late_prefetches
+            << ", \"useless_prefetches\": " << stats.useless_prefetches
+            << ", \"prefetch_cycles\": " << stats.prefetch_cycles
+            << ", \"write_buffer_transactions\": " << stats.write_buffer_transactions
+            << ", \"write_buffer_merges\": " << stats.write_buffer_merges
+            << ", \"write_buffer_stall_cycles\": " << stats.write_buffer_stall_cycles << "}" << std::endl;
+        return;
+    }
+
+    if (output.format == FORMAT_CSV) {
+        out << config.num_sets << "," << config.num_blocks << "," << config.block_size << ","
+            << config.write_allocate << "," << config.write_through << "," << policyName(config.policy) << ","
+            << stats.total_loads << "," << stats.total_stores << "," << stats.load_hits << ","
+            << stats.load_misses << "," << stats.store_hits << "," << stats.store_misses << ","
+            << stats.total_cycles << "," << hit_rate << "," << miss_rate << "," << amat << "," << acpa << ","
+            << space.blocks << "," << space.data_bytes << "," << space.overheadBytes() << ","
+            << space.totalBytes() << "," << stats.split_accesses << "," << stats.sampled_accesses << ","
+            << stats.miss_rate_error << "," << stats.compulsory_misses << "," << stats.capacity_misses << ","
+            << stats.conflict_misses << "," << stats.prefetches << "," << stats.useful_prefetches << ","
+            << stats.late_prefetches << "," << stats.useless_prefetches << "," << stats.prefetch_cycles << ","
+            << stats.write_buffer_transactions << "," << stats.write_buffer_merges << ","
+            << stats.write_buffer_stall_cycles << std::endl;
+        return;
+    }
+
+    if (header) {
+        out << "./csim " << formatCacheConfig(config) << std::endl;
+    }
+    stats.print(out);
+    if (output.metrics) {
+        out << "Hit rate: " << hit_rate << std::endl;
+        out << "Miss rate: " << miss_rate << std::endl;
+        out << "Average memory access time: " << amat << std::endl;
+        out << "Average cycles per access: " << acpa << std::endl;
+        out << "Number of blocks: " << space.blocks << std::endl;
+        out << "Data bytes: " << space.data_bytes << std::endl;
+        out << "Total overhead bytes: " << space.overheadBytes() << std::endl;
+        out << "Total bytes used: " << space.totalBytes() << std::endl;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <iostream>
+#include <string>
+#include "cache.h"
+
+enum OutputFormat {
+    // the original "Total loads: ..." lines
+    FORMAT_TEXT,
+    // one object per run, one run per line
+    FORMAT_JSON,
+    // a header row, then one row per run
+    FORMAT_CSV
+};
+
+bool parseFormat(const std::string& name, OutputFormat& format);
+
+struct OutputOptions {
+    OutputFormat format = FORMAT_TEXT;
+    // add the derived metrics and space accounting to text output, json and
+    // csv always have them
+    bool metrics = false;
+};
+
+// storage a config needs, data plus the bookkeeping bits of every block
+struct CacheSpace {
+    uint64_t blocks;
+    uint64_t data_bytes;
+    // tag, valid, dirty (write-back only) and replacement state
+    uint64_t overhead_bits;
+
+    explicit CacheSpace(const CacheConfig& config);
+
+    uint64_t overheadBytes() const { return (overhead_bits + 7) / 8; }
+    uint64_t totalBytes() const { return data_bytes + overheadBytes(); }
+};
+
+// text output starts with the "./csim <config>" line when header is set, as
+// runs over many configs do. csv rows need printCsvHeader once beforehand
+void printReport(const CacheConfig& config, const CacheStats& stats, const OutputOptions& output,
+                 bool header, std::ostream& out);
+void printCsvHeader(std::ostream& out);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef RING_H
+#define RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// lock-free single producer single consumer queue of Capacity preallocated
+// slots. slots are filled and drained in place, so a batch is never copied:
+//   producer: T* slot = ring.writeSlot(); ...fill...; ring.push();
+//   consumer: T* slot = ring.readSlot(); ...use...;  ring.pop();
+// both sides spin, yielding, while the ring is full or empty
+template <typename T, size_t Capacity>
+class SpscRing {
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of 2");
+
+    std::vector<T> slots;
+    // each index is written by one side only, on its own cache line so the
+    // two threads do not fight over it
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+public:
+    SpscRing() : slots(Capacity), head(0), tail(0) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // the next free slot, nullptr if every slot is in use
+    T* tryWriteSlot() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) {
+            return nullptr;
+        }
+        return &slots[t & (Capacity - 1)];
+    }
+
+    // the next free slot, waiting for the consumer if every slot is in use
+    T* writeSlot() {
+        T* slot;
+        while (!(slot = tryWriteSlot())) {
+            std::this_thread::yield();
+        }
+        return slot;
+    }
+
+    // hands the slot from writeSlot to the consumer
+    void push() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // the oldest pushed slot, nullptr if there is none
+    T* tryReadSlot() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == h) {
+            return nullptr;
+        }
+        return &slots[h & (Capacity - 1)];
+    }
+
+    // the oldest pushed slot, waiting for the producer if there is none
+    T* readSlot() {
+        T* slot;
+        while (!(slot = tryReadSlot())) {
+            std::this_thread::yield();
+        }
+        return slot;
+    }
+
+    // gives the slot from readSlot back to the producer
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+#endif
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "sample.h"
+
+// spreads consecutive set indices over the whole range (splitmix64's finaliser)
+static uint64_t mixSet(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// the counters a stretch of accesses added, a minus b
+static CacheStats difference(const CacheStats& a, const CacheStats& b) {
+    CacheStats d;
+    d.total_loads = a.total_loads - b.total_loads;
+    d.total_stores = a.total_stores - b.total_stores;
+    d.load_hits = a.load_hits - b.load_hits;
+    d.load_misses = a.load_misses - b.load_misses;
+    d.store_hits = a.store_hits - b.store_hits;
+    d.store_misses = a.store_misses - b.store_misses;
+    d.total_cycles = a.total_cycles - b.total_cycles;
+    d.split_accesses = a.split_accesses - b.split_accesses;
+    return d;
+}
+
+// x * part / whole, the share of x the sample says part is
+static uint64_t scale(uint64_t x, uint64_t part, uint64_t whole) {
+    return whole ? uint64_t(std::llround(double(x) * part / whole)) : 0;
+}
+
+SampledCache::SampledCache(std::unique_ptr<Cache> cache, const CacheConfig& config)
+    : cache(std::move(cache)), sampling(config.sampling), set_mask(config.num_sets - 1),
+      block_bits(std::log2(config.block_size)), block_offset_mask(config.block_size - 1),
+      split_accesses(config.split_accesses),
+      group_sets(config.policy != POLICY_RANDOM && config.policy != POLICY_BRRIP), num_sets(config.num_sets),
+      set_chunk(SET_CHUNK), record_loads(0), record_stores(0), measured_loads(0), measured_stores(0), address_mask(0), position(0),
+      measuring(false) {
+    if (sampling.set_ratio > 1) {
+        // the sets with the smallest hashes, so exactly num_sets / set_ratio
+        // of them are kept whatever the hash does
+        std::vector<std::pair<uint64_t, int>> order;
+        for (int i = 0; i < num_sets; i++) {
+            order.emplace_back(mixSet(i), i);
+        }
+        size_t samples = std::max(1u, unsigned(num_sets) / sampling.set_ratio);
+        std::nth_element(order.begin(), order.begin() + (samples - 1), order.end());
+
+        sample_of_set.assign(num_sets, -1);
+        for (size_t i = 0; i < samples; i++) {
+            sample_of_set[order[i].second] = i;
+        }
+        set_accesses.assign(samples, 0);
+        set_misses.assign(samples, 0);
+        set_starts.assign(samples + 1, 0);
+        // big enough that clearing set_starts is not most of a flush
+        set_chunk = std::max<size_t>(SET_CHUNK, 4 * samples);
+    }
+}
+
+void SampledCache::processBatch(const Access* accesses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (accesses[i].operation == 'l') {
+            record_loads++;
+        } else {
+            record_stores++;
+        }
+        address_mask |= accesses[i].address;
+    }
+    if (!sampling.period) {
+        processSets(accesses, count);
+        return;
+    }
+
+    // cut the batch where it crosses the end of a warmup, a window or a period
+    uint64_t window_end = sampling.warmup + sampling.window;
+    size_t i = 0;
+    while (i < count) {
+        uint64_t phase = position % sampling.period;
+        uint64_t boundary = phase < sampling.warmup ? sampling.warmup
+                          : phase < window_end ? window_end : sampling.period;
+        size_t n = std::min<uint64_t>(count - i, boundary - phase);
+        if (phase < sampling.warmup) {
+            processSegment(accesses + i, n, false);
+        } else if (phase < window_end) {
+            if (!measuring) {
+                measuring = true;
+                window_start = cache->getStats();
+            }
+            processSegment(accesses + i, n, true);
+            if (phase + n == window_end) {
+                endWindow();
+            }
+        }
+        position += n;
+        i += n;
+    }
+}
+
+void SampledCache::processSets(const Access* accesses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int sample = sample_of_set[(accesses[i].address >> block_bits) & set_mask];
+        if (sample < 0) {
+            continue;
+        }
+        if (accesses[i].operation == 'l') {
+            measured_loads++;
+        } else {
+            measured_stores++;
+        }
+        // a record split into the next set has to reach both sets in trace
+        // order, so it goes on its own after everything before it
+        if (split_accesses && (accesses[i].address & block_offset_mask) + std::max<int>(accesses[i].size, 1)
+                                  > block_offset_mask + 1) {
+            flushSets();
+            buffer.push_back(accesses[i]);
+            buffer_samples.push_back(sample);
+            flushSets();
+            continue;
+        }
+        buffer.push_back(accesses[i]);
+        buffer_samples.push_back(sample);
+        if (buffer.size() == set_chunk) {
+            flushSets();
+        }
+    }
+    flushSets();
+}
+
+void SampledCache::flushSets() {
+    // sets never share blocks, so each sampled set's accesses can go to the
+    // cache in one batch, in their own order, with its misses read off the
+    // counters around it. random and brrip draw from state all the sets
+    // share, so for them only runs of accesses to one set are batched
+    const CacheStats& stats = cache->getStats();
+    auto forward = [&](const Access* accesses, size_t count, int sample) {
+        uint64_t before_accesses = stats.accesses();
+        uint64_t before_misses = stats.misses();
+        cache->processBatch(accesses, count);
+        set_accesses[sample] += stats.accesses() - before_accesses;
+        set_misses[sample] += stats.misses() - before_misses;
+    };
+
+    if (group_sets) {
+        // counting sort by sample, which keeps each set's own order
+        std::fill(set_starts.begin(), set_starts.end(), 0);
+        for (int sample : buffer_samples) {
+            set_starts[sample + 1]++;
+        }
+        for (size_t i = 1; i < set_starts.size(); i++) {
+            set_starts[i] += set_starts[i - 1];
+        }
+        grouped.resize(buffer.size());
+        for (size_t i = 0; i < buffer.size(); i++) {
+            grouped[set_starts[buffer_samples[i]]++] = buffer[i];
+        }
+        // set_starts[s] has moved on to where sample s ends
+        uint32_t first = 0;
+        for (size_t sample = 0; sample + 1 < set_starts.size(); sample++) {
+            if (set_starts[sample] > first) {
+                forward(grouped.data() + first, set_starts[sample] - first, sample);
+            }
+            first = set_starts[sample];
+        }
+    } else {
+        for (size_t first = 0; first < buffer.size();) {
+            size_t last = first + 1;
+            while (last < buffer.size() && buffer_samples[last] == buffer_samples[first]) {
+                last++;
+            }
+            forward(buffer.data() + first, last - first, buffer_samples[first]);
+            first = last;
+        }
+    }
+    buffer.clear();
+    buffer_samples.clear();
+}
+
+void SampledCache::processSegment(const Access* accesses, size_t count, bool counted) {
+    if (!sample_of_set.empty()) {
+        buffer.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (sampledSet(accesses[i].address)) {
+                buffer.push_back(accesses[i]);
+            }
+        }
+        accesses = buffer.data();
+        count = buffer.size();
+    }
+    if (counted) {
+        for (size_t i = 0; i < count; i++) {
+            if (accesses[i].operation == 'l') {
+                measured_loads++;
+            } else {
+                measured_stores++;
+            }
+        }
+    }
+    cache->processBatch(accesses, count);
+}
+
+void SampledCache::endWindow() {
+    CacheStats window = difference(cache->getStats(), window_start);
+    windows += window;
+    window_sums.add(window.accesses(), window.misses());
+    measuring = false;
+}
+
+void SampledCache::resetStats() {
+    cache->resetStats();
+    record_loads = 0;
+    record_stores = 0;
+    measured_loads = 0;
+    measured_stores = 0;
+    std::fill(set_accesses.begin(), set_accesses.end(), 0);
+    std::fill(set_misses.begin(), set_misses.end(), 0);
+    windows = CacheStats();
+    window_sums = SampleSums();
+    // a window under way restarts from here, where the periods stay
+    window_start = cache->getStats();
+}
+
+// half width of the 95% interval of the ratio estimate misses / accesses, out
+// of population units of which sums has a simple random sample
+static double missRateError(const SampleSums& sums, double population) {
+    if (sums.count < 2 || sums.accesses == 0) {
+        // no spread to go on, the rate could be anything
+        return 1;
+    }
+    double rate = sums.misses / sums.accesses;
+    double variance = (sums.misses2 - 2 * rate * sums.products + rate * rate * sums.accesses2) / (sums.count - 1);
+    double mean = sums.accesses / sums.count;
+    double correction = std::max(0.0, 1 - sums.count / population);
+    return 1.96 * std::sqrt(std::max(0.0, correction * variance / sums.count)) / mean;
+}
+
+const CacheStats& SampledCache::getStats() const {
+    CacheStats measured;
+    SampleSums sums;
+    double population;
+    if (sampling.period) {
+        measured = windows;
+        sums = window_sums;
+        if (measuring) {
+            // the window the trace ended in counts for what it got through
+            CacheStats window = difference(cache->getStats(), window_start);
+            measured += window;
+            sums.add(window.accesses(), window.misses());
+        }
+        // the trace holds this many windows' worth of accesses to sample from
+        population = std::ceil(double(position) / sampling.window);
+    } else {
+        measured = cache->getStats();
+        for (size_t i = 0; i < set_accesses.size(); i++) {
+            sums.add(set_accesses[i], set_misses[i]);
+        }
+        population = num_sets;
+    }
+
+    estimate = CacheStats();
+    estimate.total_loads = scale(record_loads, measured.total_loads, measured_loads);
+    estimate.total_stores = scale(record_stores, measured.total_stores, measured_stores);
+    estimate.load_misses = scale(estimate.total_loads, measured.load_misses, measured.total_loads);
+    estimate.load_hits = estimate.total_loads - estimate.load_misses;
+    estimate.store_misses = scale(estimate.total_stores, measured.store_misses, measured.total_stores);
+    estimate.store_hits = estimate.total_stores - estimate.store_misses;
+    estimate.total_cycles = scale(estimate.accesses(), measured.total_cycles, measured.accesses());
+    estimate.split_accesses = scale(record_loads + record_stores, measured.split_accesses,
+                                    measured_loads + measured_stores);
+    estimate.address_mask = address_mask;
+    estimate.sampled_accesses = measured.accesses();
+    estimate.miss_rate_error = missRateError(sums, population);
+    return estimate;
+}
@@ -0,0 +1,123 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cache.h"
+
+// running sums over the samples of a sampled run, what the variance of the
+// ratio estimate of the miss rate needs
+struct SampleSums {
+    double count = 0;
+    double accesses = 0;
+    double misses = 0;
+    double accesses2 = 0;
+    double misses2 = 0;
+    double products = 0;
+
+    void add(double a, double m) {
+        count++;
+        accesses += a;
+        misses += m;
+        accesses2 += a * a;
+        misses2 += m * m;
+        products += a * m;
+    }
+};
+
+// runs a cache over part of the trace and scales the counters up to the whole
+// of it. set sampling only simulates the accesses to a hashed subset of the
+// sets, time sampling only the windows of config.sampling. the miss rate of
+// each sampled set, or each window, is one sample of the whole trace's, and
+// their spread gives the confidence interval getStats() reports.
+// the loads and stores of every record are still counted, so the estimates
+// are ratios to exact totals
+class SampledCache : public Cache {
+private:
+    std::unique_ptr<Cache> cache;
+    SamplingConfig sampling;
+    unsigned int set_mask;
+    int block_bits;
+    Address block_offset_mask;
+    bool split_accesses;
+    // whether the sampled sets' accesses may be reordered set by set
+    bool group_sets;
+
+    // index into set_accesses and set_misses of each sampled set, -1 for
+    // the sets that are skipped. empty without set sampling
+    std::vector<int> sample_of_set;
+    std::vector<uint64_t> set_accesses;
+    std::vector<uint64_t> set_misses;
+    int num_sets;
+
+    // accesses to the sampled sets are collected in buffer, with their
+    // samples, up to set_chunk at a time, and handed to the cache a set at
+    // a time
+    static constexpr size_t SET_CHUNK = 4096;
+    size_t set_chunk;
+    std::vector<int> buffer_samples;
+    std::vector<Access> grouped;
+    std::vector<uint32_t> set_starts;
+
+    // every record seen, and the ones that were simulated and counted
+    uint64_t record_loads;
+    uint64_t record_stores;
+    uint64_t measured_loads;
+    uint64_t measured_stores;
+    Address address_mask;
+
+    // time sampling: accesses seen so far, the counters of the finished
+    // windows and the cache's counters when the current one began
+    uint64_t position;
+    bool measuring;
+    CacheStats window_start;
+    CacheStats windows;
+    SampleSums window_sums;
+    std::vector<Access> buffer;
+
+    mutable CacheStats estimate;
+
+    bool sampledSet(Address address) const {
+        return sample_of_set.empty() || sample_of_set[(address >> block_bits) & set_mask] >= 0;
+    }
+    void processSets(const Access* accesses, size_t count);
+    void flushSets();
+    // the accesses of one stretch of a period, all warmup or all window
+    void processSegment(const Access* accesses, size_t count, bool counted);
+    void endWindow();
+
+public:
+    // cache must be unsampled, it does the simulating
+    SampledCache(std::unique_ptr<Cache> cache, const CacheConfig& config);
+
+    void processTrace(const Access* accesses, size_t count) override { processBatch(accesses, count); }
+    void processBatch(const Access* accesses, size_t count) override;
+
+    // the rest go straight to the wrapped cache, unsampled
+    AccessResult access(char operation, Address address) override { return cache->access(operation, address); }
+    bool invalidate(Address address, bool& dirty) override { return cache->invalidate(address, dirty); }
+    bool clean(Address address) override { return cache->clean(address); }
+    bool markDirty(Address address) override { return cache->markDirty(address); }
+    AccessResult insert(Address address, bool dirty) override { return cache->insert(address, dirty); }
+    AccessResult prefetch(Address address) override { return cache->prefetch(address); }
+    int blockSize() const override { return cache->blockSize(); }
+    void setShard(unsigned int first, unsigned int count) override { cache->setShard(first, count); }
+    void processShardTrace(const Access* accesses, size_t count) override {
+        cache->processShardTrace(accesses, count);
+    }
+
+    // the estimate for everything processed so far
+    const CacheStats& getStats() const override;
+    void resetStats() override;
+
+    // the sampling state would have to go with it, sampled runs are quick
+    // enough to redo
+    bool saveCheckpoint(std::ostream&) override { return false; }
+    bool loadCheckpoint(std::istream&, std::ostream& err) override {
+        err << "sampled runs cannot be checkpointed" << std::endl;
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,597 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "outcome.h"
+#include "prefetch.h"
+#include "report.h"
+#include "server.h"
+#include "trace.h"
+
+// a fixed set of threads running jobs in the order they were submitted
+class WorkerPool {
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> jobs;
+    bool stopping;
+    std::vector<std::thread> threads;
+
+    void work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    explicit WorkerPool(int count) : stopping(false) {
+        for (int i = 0; i < std::max(count, 1); i++) {
+            threads.emplace_back([this]() { work(); });
+        }
+    }
+
+    // finishes every job already submitted first
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::future<std::string> submit(std::function<std::string()> fn) {
+        auto task = std::make_shared<std::packaged_task<std::string()>>(std::move(fn));
+        std::future<std::string> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back([task]() { (*task)(); });
+        }
+        ready.notify_one();
+        return result;
+    }
+};
+
+struct ResidentTrace {
+    std::vector<Access> accesses;
+    uint64_t hash;
+};
+
+// every trace a request has named, decoded once and shared by all the runs
+// over it. a trace is loaded by the first request that wants it while the
+// others wait for that load rather than starting their own
+class TraceStore {
+private:
+    typedef std::shared_future<std::shared_ptr<const ResidentTrace>> Loading;
+    std::mutex mutex;
+    std::map<std::string, Loading> traces;
+
+public:
+    // nullptr, with the reason in error, if path cannot be read
+    std::shared_ptr<const ResidentTrace> get(const std::string& path, std::string& error) {
+        std::promise<std::shared_ptr<const ResidentTrace>> promise;
+        Loading loading;
+        bool load = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = traces.find(path);
+            if (it != traces.end()) {
+                loading = it->second;
+            } else {
+                loading = promise.get_future().share();
+                traces[path] = loading;
+                load = true;
+            }
+        }
+
+        if (load) {
+            std::shared_ptr<ResidentTrace> trace;
+            if (TraceFile(path).fd() >= 0) {
+                TraceOptions input;
+                input.path = path;
+                input.fast = true;
+                trace = std::make_shared<ResidentTrace>();
+                if (loadTrace(input, trace->accesses)) {
+                    trace->hash = hashTrace(trace->accesses);
+                } else {
+                    trace.reset();
+                }
+            }
+            promise.set_value(trace);
+            if (!trace) {
+                // so a later request can try again
+                std::lock_guard<std::mutex> lock(mutex);
+                traces.erase(path);
+            }
+        }
+
+        std::shared_ptr<const ResidentTrace> trace = loading.get();
+        if (!trace) {
+            // missing, or compressed and corrupt
+            error = "could not read trace file " + path;
+        }
+        return trace;
+    }
+
+    // runs already under way keep their copy
+    bool unload(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return traces.erase(path) > 0;
+    }
+
+    // the loaded traces and their lengths, leaving out any still loading
+    std::vector<std::pair<std::string, size_t>> loaded() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::pair<std::string, size_t>> result;
+        for (const auto& entry : traces) {
+            if (entry.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready && entry.second.get()) {
+                result.emplace_back(entry.first, entry.second.get()->accesses.size());
+            }
+        }
+        return result;
+    }
+};
+
+struct Server {
+    const ServerOptions& options;
+    TraceStore traces;
+    WorkerPool pool;
+
+    explicit Server(const ServerOptions& options) : options(options), pool(options.threads) {}
+};
+
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+static std::string errorResponse(const std::string& message) {
+    // parseCacheConfig's messages end in newlines
+    std::string trimmed = message.substr(0, message.find_last_not_of('\n') + 1);
+    return "{\"error\": " + jsonString(trimmed) + "}\n";
+}
+
+static bool parseNumber(const std::string& text, uint64_t& value) {
+    char* end;
+    value = std::strtoull(text.c_str(), &end, 10);
+    return !text.empty() && text[0] != '-' && *end == '\0';
+}
+
+// the most blocks a requested cache may have, sets times ways
+static const uint64_t MAX_BLOCKS = uint64_t(1) << 24;
+
+// the config and warmup of a run request, words[2] on, over the defaults
+static bool parseRunRequest(const std::vector<std::string>& words, const CacheConfig& defaults, CacheConfig& config,
+                            uint64_t& warmup, std::string& error) {
+    config = defaults;
+    warmup = 0;
+    std::vector<std::string> args;
+    for (size_t i = 2; i < words.size(); i++) {
+        const std::string& word = words[i];
+        if (word.compare(0, 2, "--") != 0) {
+            args.push_back(word);
+            continue;
+        }
+        if (word == "--split-accesses") {
+            config.split_accesses = true;
+            continue;
+        }
+        if (word == "--classify") {
+            config.classify_misses = true;
+            continue;
+        }
+        if (i + 1 == words.size()) {
+            error = word + " needs a value";
+            return false;
+        }
+        const std::string& value = words[++i];
+        if (word == "--prefetch") {
+            if (!parsePrefetcher(value, config.prefetch.kind)) {
+                error = "--prefetch must be none, next-line, stream or tagged";
+                return false;
+            }
+            continue;
+        }
+        uint64_t number;
+        if (!parseNumber(value, number)) {
+            error = word + " takes a non-negative number";
+            return false;
+        }
+        if (word == "--warmup") {
+            warmup = number;
+        } else if (word == "--hit-cycles") {
+            config.latency.hit_cycles = number;
+        } else if (word == "--memory-latency") {
+            config.latency.memory_latency = number;
+        } else if (word == "--word-cycles") {
+            config.latency.word_cycles = number;
+        } else if (word == "--writeback-cycles") {
+            config.latency.writeback_cycles = number;
+        } else if (word == "--address-bits" && number >= 32 && number <= 64) {
+            config.address_bits = number;
+        } else if (word == "--prefetch-degree" && number >= 1 && number <= 64) {
+            config.prefetch.degree = number;
+        } else if (word == "--write-buffer" && number >= 1 && number <= 1024) {
+            config.write_buffer = number;
+        } else {
+            error = "unknown option or value out of range: " + word + " " + value;
+            return false;
+        }
+    }
+
+    std::ostringstream err;
+    if (!parseCacheConfig(args, config, err)) {
+        error = err.str();
+        return false;
+    }
+    if (config.classify_misses && config.prefetch.enabled()) {
+        error = "--prefetch does not work with --classify";
+        return false;
+    }
+    if (tagBits(config) < 0) {
+        error = "the set index and block offset need more than the " + std::to_string(config.address_bits)
+            + " address bits";
+        return false;
+    }
+    // one request must not be able to take all of the server's memory
+    if (uint64_t(config.num_sets) * config.num_blocks > MAX_BLOCKS) {
+        error = "a cache may have at most " + std::to_string(MAX_BLOCKS) + " blocks";
+        return false;
+    }
+    return true;
+}
+
+// run <trace> <six cache arguments> [options]
+static std::string runRequest(const std::vector<std::string>& words, Server& server) {
+    if (words.size() < 2) {
+        return errorResponse("run takes a trace and the six cache arguments");
+    }
+    CacheConfig config;
+    uint64_t warmup;
+    std::string error;
+    if (!parseRunRequest(words, server.options.defaults, config, warmup, error)) {
+        return errorResponse(error);
+    }
+    std::shared_ptr<const ResidentTrace> trace = server.traces.get(words[1], error);
+    if (!trace) {
+        return errorResponse(error);
+    }
+
+    CacheStats stats;
+    if (!server.options.outcome_dir.empty() && !config.classify_misses && !config.prefetch.enabled()) {
+        OutcomeLog log;
+        std::ostringstream err;
+        if (!cachedOutcomes(server.options.outcome_dir, trace->accesses, trace->hash, config, log, err)) {
+            return errorResponse(err.str());
+        }
+        stats = replayOutcomes(trace->accesses, log, config, warmup);
+    } else {
+        const std::vector<Access>& accesses = trace->accesses;
+        size_t warm = std::min<uint64_t>(warmup, accesses.size());
+        std::unique_ptr<Cache> cache = makeCache(config);
+        if (warmup > 0) {
+            cache->processTrace(accesses.data(), warm);
+            cache->resetStats();
+        }
+        cache->processTrace(accesses.data() + warm, accesses.size() - warm);
+        stats = cache->getStats();
+    }
+
+    OutputOptions output;
+    output.format = FORMAT_JSON;
+    std::ostringstream report;
+    printReport(config, stats, output, false, report);
+    return report.str();
+}
+
+static std::string handleRequest(const std::vector<std::string>& words, Server& server) {
+    const std::string& command = words[0];
+    if (command == "run") {
+        try {
+            return runRequest(words, server);
+        } catch (const std::exception& e) {
+            // e.g. bad_alloc, which must not end the other requests too
+            return errorResponse(std::string("run failed: ") + e.what());
+        }
+    }
+    if (command == "load" && words.size() == 2) {
+        std::string error;
+        std::shared_ptr<const ResidentTrace> trace = server.traces.get(words[1], error);
+        if (!trace) {
+            return errorResponse(error);
+        }
+        return "{\"trace\": " + jsonString(words[1]) + ", \"accesses\": " + std::to_string(trace->accesses.size())
+            + "}\n";
+    }
+    if (command == "unload" && words.size() == 2) {
+        if (!server.traces.unload(words[1])) {
+            return errorResponse(words[1] + " is not loaded");
+        }
+        return "{\"trace\": " + jsonString(words[1]) + ", \"unloaded\": true}\n";
+    }
+    if (command == "traces" && words.size() == 1) {
+        std::string response = "{\"traces\": [";
+        bool first = true;
+        for (const auto& trace : server.traces.loaded()) {
+            response += std::string(first ? "" : ", ") + "{\"trace\": " + jsonString(trace.first)
+                + ", \"accesses\": " + std::to_string(trace.second) + "}";
+            first = false;
+        }
+        return response + "]}\n";
+    }
+    return errorResponse("unknown request " + command + ", expected run, load, unload, traces, quit or shutdown");
+}
+
+// splits what comes in on a file descriptor into lines
+class LineReader {
+private:
+    int fd;
+    std::string buffer;
+    size_t start;
+
+public:
+    explicit LineReader(int fd) : fd(fd), start(0) {}
+
+    bool next(std::string& line) {
+        for (;;) {
+            size_t end = buffer.find('\n', start);
+            if (end != std::string::npos) {
+                line = buffer.substr(start, end - start);
+                start = end + 1;
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                return true;
+            }
+            buffer.erase(0, start);
+            start = 0;
+
+            char chunk[1 << 16];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n > 0) {
+                buffer.append(chunk, n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                // the last line may have no newline
+                line = buffer;
+                buffer.clear();
+                return !line.empty();
+            }
+        }
+    }
+};
+
+static bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+// an answer being worked out on the pool, or a request to answer once all
+// the earlier ones of its connection have been
+struct Response {
+    std::future<std::string> result;
+    std::function<std::string()> after;
+};
+
+// the answers of one connection waiting to be written, in request order
+class ResponseQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Response> responses;
+    bool closed;
+
+public:
+    ResponseQueue() : closed(false) {}
+
+    void push(Response response) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            responses.push_back(std::move(response));
+        }
+        ready.notify_one();
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_one();
+    }
+
+    // false once it is closed and empty
+    bool pop(Response& response) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&]() { return closed || !responses.empty(); });
+        if (responses.empty()) {
+            return false;
+        }
+        response = std::move(responses.front());
+        responses.pop_front();
+        return true;
+    }
+};
+
+// answers the requests read from in on out until in ends or asks to quit,
+// true if it asked for the whole server to shut down
+static bool serveConnection(int in, int out, Server& server) {
+    ResponseQueue queue;
+    std::thread writer([&]() {
+        bool open = true;
+        Response response;
+        while (queue.pop(response)) {
+            // every answer is waited for, so no job outlives the connection
+            std::string text = response.after ? response.after() : response.result.get();
+            open = open && writeAll(out, text);
+        }
+    });
+
+    LineReader reader(in);
+    std::string line;
+    bool shutdown = false;
+    while (reader.next(line)) {
+        std::istringstream stream(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (stream >> word) {
+            words.push_back(word);
+        }
+        if (words.empty() || words[0][0] == '#') {
+            continue;
+        }
+        if (words[0] == "quit" || words[0] == "shutdown") {
+            shutdown = words[0] == "shutdown";
+            break;
+        }
+        auto handle = [words, &server]() { return handleRequest(words, server); };
+        Response response;
+        // only runs go to the pool, so the traces a connection sees loaded
+        // are the ones it asked for before
+        if (words[0] == "run") {
+            response.result = server.pool.submit(handle);
+        } else {
+            response.after = handle;
+        }
+        queue.push(std::move(response));
+    }
+
+    queue.close();
+    writer.join();
+    return shutdown;
+}
+
+// accepts connections on the socket until one of them asks for a shutdown
+static int serveSocket(const std::string& path, Server& server) {
+    sockaddr_un address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "socket path " << path << " is too long" << std::endl;
+        return 1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    // a socket left behind by an earlier server would make bind fail
+    unlink(path.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "could not listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 1;
+    }
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::set<int> connections;
+    bool stopping = false;
+    // wakes accept() and every connection's read, so all of them wind down
+    auto stop = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (int fd : connections) {
+            ::shutdown(fd, SHUT_RD);
+        }
+        ::shutdown(listener, SHUT_RDWR);
+    };
+
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (errno == EINTR && !stopping) {
+                continue;
+            }
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                close(fd);
+                break;
+            }
+            connections.insert(fd);
+        }
+        std::thread([&, fd]() {
+            bool shutdown = serveConnection(fd, fd, server);
+            if (shutdown) {
+                stop();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.erase(fd);
+            close(fd);
+            finished.notify_all();
+        }).detach();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return connections.empty(); });
+    close(listener);
+    unlink(path.c_str());
+    return 0;
+}
+
+int runServer(const ServerOptions& options) {
+    // a client that goes away mid answer must not take the server with it
+    std::signal(SIGPIPE, SIG_IGN);
+    Server server(options);
+    if (options.socket_path.empty()) {
+        serveConnection(STDIN_FILENO, STDOUT_FILENO, server);
+        return 0;
+    }
+    return serveSocket(options.socket_path, server);
+}
@@ -0,0 +1,38 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include "cache.h"
+
+struct ServerOptions {
+    // workers running the requests
+    int threads = 1;
+    // unix socket to listen on, stdin and stdout when empty
+    std::string socket_path;
+    // the settings every run request starts from, as applyCacheOptions
+    // copies them from the command line
+    CacheConfig defaults;
+    // --outcome-cache directory for the runs it applies to, empty for none
+    std::string outcome_dir;
+};
+
+// a long running csim answering requests, one per line, each with one line
+// of json. traces stay decoded in memory once a request has named them, so
+// only the first request for a trace pays for parsing it:
+//
+//   run <trace> <six cache arguments> [options]   the printReport json
+//   load <trace>                                  {"trace": ..., "accesses": ...}
+//   unload <trace>                                {"trace": ..., "unloaded": true}
+//   traces                                        {"traces": [...]}
+//   quit                                          ends the connection
+//   shutdown                                      ends the server
+//
+// run takes --warmup, the latency options, --address-bits, --split-accesses,
+// --classify, --prefetch, --prefetch-degree and --write-buffer. a request
+// that fails gets {"error": ...}. runs go to the worker pool as they come,
+// the other requests wait for the runs a connection asked for before them,
+// and every connection gets its answers in the order it asked.
+// returns the exit status for main()
+int runServer(const ServerOptions& options);
+
+#endif
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include "sweep.h"
+
+StackDistanceSweep::StackDistanceSweep(int max_sets, int max_blocks_per_set, int bytes_per_block)
+    : max_ways(max_blocks_per_set), block_size(bytes_per_block), split_accesses(0) {
+    block_bits = std::log2(block_size);
+
+    // one level per power-of-2 set count up to max_sets
+    int max_set_bits = std::log2(max_sets);
+    for (int bits = 0; bits <= max_set_bits; bits++) {
+        Level level;
+        level.set_bits = bits;
+        level.entries.resize((size_t(1) << bits) * max_ways);
+        level.depth.assign(size_t(1) << bits, 0);
+        level.load_hist.assign(max_ways + 1, 0);
+        level.store_hist.assign(max_ways + 1, 0);
+        level.writebacks.assign(max_ways + 1, 0);
+        levels.push_back(std::move(level));
+    }
+}
+
+void StackDistanceSweep::processAccess(char operation, Address address) {
+    Address block = address >> block_bits;
+    for (Level& level : levels) {
+        processLevel(level, operation, block);
+    }
+}
+
+void StackDistanceSweep::processSplitAccess(char operation, Address address, int size) {
+    Address first = address >> block_bits;
+    Address last = (address + std::max(size, 1) - 1) >> block_bits;
+    if (first != last) {
+        split_accesses++;
+    }
+    processAccess(operation, address);
+    for (Address block = first + 1; block <= last; block++) {
+        processAccess(operation, block << block_bits);
+    }
+}
+
+void StackDistanceSweep::resetStats() {
+    for (Level& level : levels) {
+        std::fill(level.load_hist.begin(), level.load_hist.end(), 0);
+        std::fill(level.store_hist.begin(), level.store_hist.end(), 0);
+        std::fill(level.writebacks.begin(), level.writebacks.end(), 0);
+    }
+    split_accesses = 0;
+}
+
+void StackDistanceSweep::processLevel(Level& level, char operation, Address block) {
+    unsigned int set_index = block & ((1u << level.set_bits) - 1);
+    Entry* stack = &level.entries[size_t(set_index) * max_ways];
+    int& size = level.depth[set_index];
+    bool store = operation != 'l';
+    std::vector<uint64_t>& hist = store ? level.store_hist : level.load_hist;
+
+    int d = 0;
+    while (d < size && stack[d].block != block) {
+        d++;
+    }
+
+    Entry top;
+    top.block = block;
+    if (d < size) {
+        // hit in every cache with more than d ways
+        hist[d]++;
+        // a store dirties it everywhere, the caches that missed reload it
+        top.max_depth = store ? 0 : stack[d].max_depth;
+    } else {
+        hist[max_ways]++;
+        top.max_depth = store ? 0 : max_ways;
+        if (size < max_ways) {
+            size++;
+        } else if (stack[max_ways - 1].max_depth < max_ways) {
+            // bottom entry falls out of the largest cache dirty
+            level.writebacks[max_ways]++;
+        }
+        d = size - 1;
+    }
+
+    // everything above d moves down one, a dirty block reaching a new depth i
+    // has just been evicted from the i-way cache
+    for (int i = d; i > 0; i--) {
+        stack[i] = stack[i - 1];
+        if (stack[i].max_depth < i) {
+            level.writebacks[i]++;
+            stack[i].max_depth = i;
+        }
+    }
+    stack[0] = top;
+}
+
+void StackDistanceSweep::printStats(bool write_through, const LatencyModel& latency,
+                                    const OutputOptions& output) const {
+    uint64_t miss_cost = latency.missCycles(block_size);
+    uint64_t writeback_cost = latency.writebackCycles(block_size);
+    if (output.format == FORMAT_CSV) {
+        printCsvHeader(std::cout);
+    }
+
+    for (const Level& level : levels) {
+        uint64_t total_loads = 0;
+        uint64_t total_stores = 0;
+        for (int d = 0; d <= max_ways; d++) {
+            total_loads += level.load_hist[d];
+            total_stores += level.store_hist[d];
+        }
+
+        uint64_t load_hits = 0;
+        uint64_t store_hits = 0;
+        int d = 0;
+        for (int ways = 1; ways <= max_ways; ways *= 2) {
+            for (; d < ways; d++) {
+                load_hits += level.load_hist[d];
+                store_hits += level.store_hist[d];
+            }
+            CacheStats stats;
+            stats.total_loads = total_loads;
+            stats.total_stores = total_stores;
+            stats.load_hits = load_hits;
+            stats.load_misses = total_loads - load_hits;
+            stats.store_hits = store_hits;
+            stats.store_misses = total_stores - store_hits;
+            stats.split_accesses = split_accesses;
+
+            stats.total_cycles = stats.accesses() * latency.hit_cycles + stats.misses() * miss_cost;
+            if (write_through) {
+                stats.total_cycles += total_stores * latency.storeThroughCycles();
+            } else {
+                stats.total_cycles += level.writebacks[ways] * writeback_cost;
+            }
+
+            CacheConfig config;
+            config.num_sets = 1 << level.set_bits;
+            config.num_blocks = ways;
+            config.block_size = block_size;
+            config.write_allocate = true;
+            config.write_through = write_through;
+            config.policy = POLICY_LRU;
+            config.latency = latency;
+
+            printReport(config, stats, output, true, std::cout);
+            if (output.format == FORMAT_TEXT) {
+                std::cout << std::endl;
+            }
+        }
+    }
+}
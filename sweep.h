@@ -0,0 +1,56 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdint>
+#include <vector>
+#include "cache.h"
+#include "report.h"
+
+// single pass lru sweep over every sets x blocks_per_set geometry at one
+// block size, using per-set lru stack distances (mattson et al.)
+// only write-allocate lru caches have the inclusion property this relies on,
+// so no-write-allocate and fifo still need a full CacheSimulator run
+class StackDistanceSweep {
+private:
+    // one stack entry, most recently used first
+    struct Entry {
+        Address block;
+        // deepest position reached since the last store, the block is dirty
+        // in every cache with more ways than this. max_ways means clean
+        int max_depth;
+    };
+
+    // all the stacks for a single set count
+    struct Level {
+        int set_bits;
+        std::vector<Entry> entries;
+        std::vector<int> depth;
+        // hits by stack distance, index max_ways counts the misses
+        std::vector<uint64_t> load_hist;
+        std::vector<uint64_t> store_hist;
+        // dirty evictions by number of ways, index 0 unused
+        std::vector<uint64_t> writebacks;
+    };
+
+    int max_ways;
+    int block_size;
+    int block_bits;
+    std::vector<Level> levels;
+    uint64_t split_accesses;
+
+    void processLevel(Level& level, char operation, Address block);
+
+public:
+    StackDistanceSweep(int max_sets, int max_blocks_per_set, int bytes_per_block);
+
+    void processAccess(char operation, Address address);
+    // processAccess once per block the size bytes at address touch
+    void processSplitAccess(char operation, Address address, int size);
+    // zeroes the counts but keeps the stacks, for leaving a warmup out
+    void resetStats();
+    // one report per geometry, as printReport formats them
+    void printStats(bool write_through, const LatencyModel& latency = LatencyModel(),
+                    const OutputOptions& output = OutputOptions()) const;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TAGMATCH_H
+#define TAGMATCH_H
+
+#include <cstdint>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// tags are stored with their top bit set while the way is valid, so an empty
+// way (0) can never match a lookup and one compare covers both valid and tag
+template <typename Tag>
+constexpr Tag validTag() {
+    return Tag(1) << (sizeof(Tag) * 8 - 1);
+}
+
+// index of the way in tags[0, ways) equal to key, or -1. ways is a power of 2
+// so each vector loop only runs when it divides evenly
+inline int findWay(const uint32_t* tags, int ways, uint32_t key) {
+#if defined(__AVX2__)
+    if (ways >= 8) {
+        __m256i k = _mm256_set1_epi32(key);
+        for (int i = 0; i < ways; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags + i));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, k)));
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return -1;
+    }
+#endif
+#if defined(__SSE2__)
+    if (ways >= 4) {
+        __m128i k = _mm_set1_epi32(key);
+        for (int i = 0; i < ways; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + i));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, k)));
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return -1;
+    }
+#endif
+    for (int i = 0; i < ways; i++) {
+        if (tags[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// the same for 64 bit tags, half as many ways per vector
+inline int findWay(const uint64_t* tags, int ways, uint64_t key) {
+#if defined(__AVX2__)
+    if (ways >= 4) {
+        __m256i k = _mm256_set1_epi64x(key);
+        for (int i = 0; i < ways; i += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags + i));
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, k)));
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return -1;
+    }
+#endif
+#if defined(__SSE2__)
+    if (ways >= 2) {
+        __m128i k = _mm_set1_epi64x(key);
+        for (int i = 0; i < ways; i += 2) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + i));
+            // sse2 has no 64 bit compare, both 32 bit halves have to match
+            __m128i eq = _mm_cmpeq_epi32(v, k);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return -1;
+    }
+#endif
+    for (int i = 0; i < ways; i++) {
+        if (tags[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+static const size_t READ_CHUNK = 1 << 20;
+
+TraceFile::TraceFile(const std::string& path) : descriptor(0), owned(false) {
+    if (!path.empty()) {
+        descriptor = open(path.c_str(), O_RDONLY);
+        owned = descriptor >= 0;
+    }
+}
+
+TraceFile::~TraceFile() {
+    if (owned) {
+        close(descriptor);
+    }
+}
+
+TraceReader::TraceReader(int fd)
+    : fd(fd), mapped(nullptr), mapped_size(0), cur(nullptr), end(nullptr), eof(false),
+      binary(false), varint(false), wide(false), record_count(0), last_address(0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // map from the current offset so "< file" and a seeked fd both work
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset < 0) {
+            offset = 0;
+        }
+        if (st.st_size <= offset) {
+            eof = true;
+            return;
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            mapped = static_cast<char*>(p);
+            mapped_size = st.st_size;
+            cur = mapped + offset;
+            end = mapped + mapped_size;
+            eof = true;
+            startDecompressor(-1);
+            readHeader();
+            return;
+        }
+    }
+    // not mappable, fall back to chunked read()
+    buffer.resize(READ_CHUNK);
+    cur = end = buffer.data();
+    while (size_t(end - cur) < BINARY_TRACE_HEADER_SIZE && refill()) {
+    }
+    startDecompressor(fd);
+    readHeader();
+}
+
+void TraceReader::startDecompressor(int source_fd) {
+    Compression kind = detectCompression(cur, end - cur);
+    if (kind == COMPRESSION_NONE) {
+        return;
+    }
+    // a mapping is read in place, bytes already read from a pipe are copied
+    // out since buffer is about to be refilled with the decompressed ones
+    const char* data = cur;
+    if (!mapped) {
+        pending.assign(cur, end);
+        data = pending.data();
+    }
+    decompressor.reset(new Decompressor(kind, data, end - cur, source_fd));
+    buffer.resize(READ_CHUNK);
+    cur = end = buffer.data();
+    eof = false;
+    while (size_t(end - cur) < BINARY_TRACE_HEADER_SIZE && refill()) {
+    }
+}
+
+static inline uint64_t readLittleEndian(const char* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | static_cast<unsigned char>(p[i]);
+    }
+    return value;
+}
+
+// switch to binary decoding if the input starts with a binary header
+void TraceReader::readHeader() {
+    if (size_t(end - cur) < BINARY_TRACE_HEADER_SIZE
+        || std::memcmp(cur, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) != 0) {
+        return;
+    }
+    if (readLittleEndian(cur + 4, 2) != BINARY_TRACE_VERSION) {
+        // unknown version, leave nothing to read
+        cur = end;
+        eof = true;
+        return;
+    }
+    binary = true;
+    varint = readLittleEndian(cur + 6, 2) & BINARY_TRACE_VARINT;
+    wide = readLittleEndian(cur + 6, 2) & BINARY_TRACE_WIDE;
+    record_count = readLittleEndian(cur + 8, 8);
+    cur += BINARY_TRACE_HEADER_SIZE;
+}
+
+TraceReader::~TraceReader() {
+    // the decompressor may still be reading the mapping
+    decompressor.reset();
+    if (mapped) {
+        munmap(mapped, mapped_size);
+    }
+}
+
+// keep the unparsed tail and append the next chunk, false once nothing is left
+bool TraceReader::refill() {
+    if (eof) {
+        return false;
+    }
+    size_t left = end - cur;
+    if (left > 0 && cur != buffer.data()) {
+        std::memmove(buffer.data(), cur, left);
+    }
+    if (left + READ_CHUNK / 2 > buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+    ssize_t n;
+    if (decompressor) {
+        n = decompressor->read(buffer.data() + left, buffer.size() - left);
+    } else {
+        do {
+            n = read(fd, buffer.data() + left, buffer.size() - left);
+        } while (n < 0 && errno == EINTR);
+    }
+    if (n <= 0) {
+        eof = true;
+    }
+    cur = buffer.data();
+    end = cur + left + (n > 0 ? n : 0);
+    return n > 0;
+}
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool TraceReader::nextText(char& operation, Address& address, int& size) {
+    // make sure a whole line is buffered before tokenizing it
+    const char* line_end;
+    for (;;) {
+        while (cur < end && isSpace(*cur)) {
+            cur++;
+        }
+        line_end = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+        if (line_end || !refill()) {
+            break;
+        }
+    }
+    if (!line_end) {
+        line_end = end;
+    }
+    const char* p = cur;
+    if (p == line_end) {
+        return false;
+    }
+
+    operation = *p++;
+    while (p < line_end && isSpace(*p)) {
+        p++;
+    }
+
+    if (p + 1 < line_end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    const char* digits = p;
+    unsigned long value = 0;
+    for (; p < line_end; p++) {
+        unsigned int d = static_cast<unsigned char>(*p) - '0';
+        if (d > 9) {
+            d = (static_cast<unsigned char>(*p) | 0x20) - 'a';
+            if (d > 5) {
+                break;
+            }
+            d += 10;
+        }
+        value = (value << 4) | d;
+    }
+    if (p == digits) {
+        return false;
+    }
+    address = value;
+
+    while (p < line_end && isSpace(*p)) {
+        p++;
+    }
+    const char* size_digits = p;
+    int n = 0;
+    for (; p < line_end && static_cast<unsigned char>(*p - '0') <= 9; p++) {
+        n = n * 10 + (*p - '0');
+    }
+    if (p == size_digits) {
+        return false;
+    }
+    size = n;
+
+    cur = line_end;
+    return true;
+}
+
+bool isBinaryTrace(int fd) {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    char magic[sizeof(BINARY_TRACE_MAGIC)];
+    return offset >= 0 && pread(fd, magic, sizeof(magic), offset) == sizeof(magic)
+        && std::memcmp(magic, BINARY_TRACE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool isCompressedTrace(int fd) {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    char magic[6];
+    ssize_t n = offset >= 0 ? pread(fd, magic, sizeof(magic), offset) : -1;
+    return n > 0 && detectCompression(magic, n) != COMPRESSION_NONE;
+}
+
+bool needsTraceReader(int fd) {
+    return lseek(fd, 0, SEEK_CUR) < 0 || isBinaryTrace(fd) || isCompressedTrace(fd);
+}
+
+// longest record: tag byte plus a 10 byte wide varint
+static const size_t MAX_BINARY_RECORD = 11;
+
+bool TraceReader::nextBinary(char& operation, Address& address, int& size) {
+    if (size_t(end - cur) < MAX_BINARY_RECORD) {
+        while (!eof && size_t(end - cur) < MAX_BINARY_RECORD) {
+            refill();
+        }
+        if (cur == end) {
+            return false;
+        }
+    }
+
+    unsigned char tag = *cur++;
+    operation = (tag & 0x80) ? 's' : 'l';
+    size = tag & BINARY_TRACE_MAX_SIZE;
+
+    if (!varint) {
+        int bytes = wide ? 8 : 4;
+        if (end - cur < bytes) {
+            return false;
+        }
+        address = readLittleEndian(cur, bytes);
+        cur += bytes;
+        return true;
+    }
+
+    uint64_t zigzag = 0;
+    for (int shift = 0; ; shift += 7) {
+        if (cur == end || shift > (wide ? 63 : 28)) {
+            return false;
+        }
+        unsigned char byte = *cur++;
+        zigzag |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    uint64_t delta = (zigzag >> 1) ^ (0 - (zigzag & 1));
+    last_address += delta;
+    if (!wide) {
+        last_address = uint32_t(last_address);
+    }
+    address = last_address;
+    return true;
+}
+
+BinaryTraceWriter::BinaryTraceWriter(bool varint)
+    : varint(varint), wide(false), record_count(0), last_address(0) {}
+
+void BinaryTraceWriter::encode(Address address) {
+    if (!varint) {
+        for (int i = 0; i < (wide ? 8 : 4); i++) {
+            data.push_back(address >> (8 * i));
+        }
+        return;
+    }
+    // narrow deltas wrap mod 2^32, zigzag keeps small negative strides short
+    int64_t delta = wide ? int64_t(address - last_address) : int32_t(uint32_t(address - last_address));
+    uint64_t zigzag = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+    while (zigzag >= 0x80) {
+        data.push_back((zigzag & 0x7f) | 0x80);
+        zigzag >>= 7;
+    }
+    data.push_back(zigzag);
+    last_address = address;
+}
+
+void BinaryTraceWriter::widen() {
+    std::vector<unsigned char> narrow;
+    narrow.swap(data);
+    data.reserve(narrow.size() * 2);
+    wide = true;
+    last_address = 0;
+
+    // every address so far fits in 32 bits, so decoding them back is exact
+    uint32_t address = 0;
+    for (size_t i = 0; i < narrow.size();) {
+        data.push_back(narrow[i++]);
+        if (!varint) {
+            address = readLittleEndian(reinterpret_cast<const char*>(&narrow[i]), 4);
+            i += 4;
+        } else {
+            uint32_t zigzag = 0;
+            for (int shift = 0; ; shift += 7) {
+                unsigned char byte = narrow[i++];
+                zigzag |= uint32_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+            address += (zigzag >> 1) ^ (0u - (zigzag & 1));
+        }
+        encode(address);
+    }
+}
+
+bool BinaryTraceWriter::add(char operation, Address address, int size) {
+    if (size < 0 || size > BINARY_TRACE_MAX_SIZE) {
+        return false;
+    }
+    if (!wide && (address >> 32) != 0) {
+        widen();
+    }
+    data.push_back((operation == 'l' ? 0 : 0x80) | size);
+    encode(address);
+    record_count++;
+    return true;
+}
+
+bool BinaryTraceWriter::write(std::ostream& out) const {
+    unsigned char header[BINARY_TRACE_HEADER_SIZE];
+    std::memcpy(header, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+    uint16_t flags = (varint ? BINARY_TRACE_VARINT : 0) | (wide ? BINARY_TRACE_WIDE : 0);
+    for (int i = 0; i < 2; i++) {
+        header[4 + i] = BINARY_TRACE_VERSION >> (8 * i);
+        header[6 + i] = flags >> (8 * i);
+    }
+    for (int i = 0; i < 8; i++) {
+        header[8 + i] = record_count >> (8 * i);
+    }
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return bool(out);
+}
+
+bool loadTrace(const TraceOptions& options, std::vector<Access>& trace) {
+    trace.clear();
+    char operation;
+    Address address;
+    int size;
+
+    TraceFile file(options.path);
+    if (options.fast || needsTraceReader(file.fd())) {
+        TraceReader reader(file.fd());
+        trace.reserve(reader.recordCount());
+        while (reader.next(operation, address, size)) {
+            trace.push_back(Access{address, operation, static_cast<unsigned char>(size)});
+        }
+        return !reader.failed();
+    }
+
+    return readTrace(options, [&](char operation, Address address, int size) {
+        trace.push_back(Access{address, operation, static_cast<unsigned char>(size)});
+    });
+}
@@ -0,0 +1,257 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include "access.h"
+#include "decompress.h"
+#include "ring.h"
+
+// binary trace layout, all fields little endian:
+//   header: "CSTB", u16 version, u16 flags, u64 record count
+//   fixed record: u8 (op << 7 | size), u32 address (u64 if WIDE)
+//   varint record: u8 (op << 7 | size), zigzag varint of the address delta,
+//   taken mod 2^32 unless WIDE
+static const char BINARY_TRACE_MAGIC[4] = {'C', 'S', 'T', 'B'};
+static const uint16_t BINARY_TRACE_VERSION = 1;
+static const uint16_t BINARY_TRACE_VARINT = 1;
+// set when an address needs more than 32 bits
+static const uint16_t BINARY_TRACE_WIDE = 2;
+static const size_t BINARY_TRACE_HEADER_SIZE = 16;
+static const int BINARY_TRACE_MAX_SIZE = 0x7f;
+
+// reads "l 0x1fffff58 1" records straight out of a file descriptor with no
+// per line allocation. regular files are mapped, pipes and terminals are read
+// in large chunks. input starting with BINARY_TRACE_MAGIC is decoded as a
+// binary trace instead, and gzip, zstd or xz input is decompressed on a
+// separate thread first
+class TraceReader {
+private:
+    int fd;
+    char* mapped;
+    size_t mapped_size;
+    std::vector<char> buffer;
+    // set for compressed input, refill() reads from it instead of fd.
+    // pending holds compressed bytes already read from a pipe
+    std::vector<char> pending;
+    std::unique_ptr<Decompressor> decompressor;
+    const char* cur;
+    const char* end;
+    bool eof;
+
+    bool binary;
+    bool varint;
+    bool wide;
+    uint64_t record_count;
+    Address last_address;
+
+    bool refill();
+    // swaps the raw input at cur for its decompressed bytes if it is compressed
+    void startDecompressor(int source_fd);
+    void readHeader();
+    bool nextText(char& operation, Address& address, int& size);
+    bool nextBinary(char& operation, Address& address, int& size);
+
+public:
+    explicit TraceReader(int fd);
+    ~TraceReader();
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    // false at end of input or on the first malformed record
+    bool next(char& operation, Address& address, int& size) {
+        return binary ? nextBinary(operation, address, size) : nextText(operation, address, size);
+    }
+
+    bool isBinary() const { return binary; }
+    // once next() has returned false, whether compressed input stopped it
+    // by failing to decompress
+    bool failed() const { return decompressor && decompressor->failed(); }
+    // record count from a binary header, 0 when unknown
+    uint64_t recordCount() const { return record_count; }
+};
+
+// keeps the encoded records in memory, the header needs the final count and
+// whether any address is wide before anything can be written. records stay
+// 32 bits wide until the first address that is not, which re-encodes the
+// ones before it
+class BinaryTraceWriter {
+private:
+    bool varint;
+    bool wide;
+    uint64_t record_count;
+    Address last_address;
+    std::vector<unsigned char> data;
+
+    // appends address at the current width
+    void encode(Address address);
+    void widen();
+
+public:
+    explicit BinaryTraceWriter(bool varint);
+
+    // false if size does not fit in the record
+    bool add(char operation, Address address, int size);
+    bool write(std::ostream& out) const;
+};
+
+// true if fd is a regular file holding a binary trace, without consuming it
+bool isBinaryTrace(int fd);
+// the same for a gzip, zstd or xz compressed trace
+bool isCompressedTrace(int fd);
+// whether fd has to go through TraceReader rather than the iostream loop:
+// a binary or compressed trace, or a pipe, whose first bytes cannot be
+// looked at without consuming them. TraceReader tells the formats apart
+// from its own first read
+bool needsTraceReader(int fd);
+
+// how csim reads its trace, set from the command line
+struct TraceOptions {
+    // file to read, stdin when empty
+    std::string path;
+    // TraceReader instead of the iostream loop
+    bool fast = false;
+    // parse on a reader thread, overlapping it with the simulation
+    bool pipelined = false;
+};
+
+// the trace file named by TraceOptions::path open for reading, or stdin
+class TraceFile {
+private:
+    int descriptor;
+    bool owned;
+
+public:
+    explicit TraceFile(const std::string& path);
+    ~TraceFile();
+
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    // -1 if the file could not be opened
+    int fd() const { return descriptor; }
+};
+
+// calls fn(operation, address, size) for every record of the trace, either
+// with the iostream loop or the fast reader. binary, compressed and piped
+// traces always take the fast reader. false if a compressed trace could not
+// be decompressed, fn has still seen every record before the error
+template <typename Fn>
+bool readRecords(const TraceOptions& options, Fn fn) {
+    char operation;
+    Address address;
+    int size;
+
+    TraceFile file(options.path);
+    if (options.fast || needsTraceReader(file.fd())) {
+        TraceReader reader(file.fd());
+        while (reader.next(operation, address, size)) {
+            fn(operation, address, size);
+        }
+        return !reader.failed();
+    }
+
+    std::ifstream in;
+    if (!options.path.empty()) {
+        in.open(options.path);
+    }
+    std::istream& stream = options.path.empty() ? std::cin : in;
+    std::string address_str;
+    while (stream >> operation >> address_str >> size) {
+        // Parse hexadecimal address
+        address = std::stoul(address_str, nullptr, 16);
+        fn(operation, address, size);
+    }
+    return true;
+}
+
+// records per batch handed to readTraceBatches callbacks
+static const size_t TRACE_BATCH = 4096;
+// batches in flight between the reader thread and the simulation
+static const size_t TRACE_PIPELINE_DEPTH = 16;
+
+struct TraceBatch {
+    Access records[TRACE_BATCH];
+    // 0 marks the end of the trace
+    size_t count;
+};
+
+// calls fn(accesses, count) once per TRACE_BATCH records so a Cache only pays
+// one virtual call per batch. pipelined, a reader thread parses into a ring
+// of batches while fn runs on the calling thread. false the same as
+// readRecords
+template <typename Fn>
+bool readTraceBatches(const TraceOptions& options, Fn fn) {
+    if (options.pipelined) {
+        // once there is a second thread, cin synced with stdio takes a lock
+        // per character. nothing has been read or written yet
+        std::ios::sync_with_stdio(false);
+        SpscRing<TraceBatch, TRACE_PIPELINE_DEPTH> ring;
+        bool ok = true;
+        std::thread reader([&]() {
+            TraceBatch* batch = ring.writeSlot();
+            batch->count = 0;
+            ok = readRecords(options, [&](char operation, Address address, int size) {
+                batch->records[batch->count++] = Access{address, operation, static_cast<unsigned char>(size)};
+                if (batch->count == TRACE_BATCH) {
+                    ring.push();
+                    batch = ring.writeSlot();
+                    batch->count = 0;
+                }
+            });
+            if (batch->count) {
+                ring.push();
+                batch = ring.writeSlot();
+                batch->count = 0;
+            }
+            ring.push();
+        });
+        for (TraceBatch* batch = ring.readSlot(); batch->count; batch = ring.readSlot()) {
+            fn(batch->records, batch->count);
+            ring.pop();
+        }
+        reader.join();
+        return ok;
+    }
+
+    std::vector<Access> batch;
+    batch.reserve(TRACE_BATCH);
+    bool ok = readRecords(options, [&](char operation, Address address, int size) {
+        batch.push_back(Access{address, operation, static_cast<unsigned char>(size)});
+        if (batch.size() == TRACE_BATCH) {
+            fn(batch.data(), batch.size());
+            batch.clear();
+        }
+    });
+    if (!batch.empty()) {
+        fn(batch.data(), batch.size());
+    }
+    return ok;
+}
+
+// calls fn(operation, address, size) for every record of the trace, false
+// the same as readRecords
+template <typename Fn>
+bool readTrace(const TraceOptions& options, Fn fn) {
+    if (options.pipelined) {
+        return readTraceBatches(options, [&](const Access* accesses, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                fn(accesses[i].operation, accesses[i].address, accesses[i].size);
+            }
+        });
+    }
+    return readRecords(options, fn);
+}
+
+// decodes the whole trace into trace, presized from the binary header when
+// there is one. false the same as readRecords
+bool loadTrace(const TraceOptions& options, std::vector<Access>& trace);
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef WRITEBUFFER_H
+#define WRITEBUFFER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "access.h"
+
+// the stores of a write-through cache on their way to memory. a store to a
+// block already waiting in the buffer is merged into its entry, any other
+// takes a new one. the oldest entry drains in the background as soon as the
+// memory is free, one transaction for every word its stores covered, and only
+// a store that finds every entry taken waits, for the oldest one to finish.
+// the cache's own fills share the memory with the drains: one goes ahead of
+// the entries still waiting but not of a drain under way, and the entries
+// drain after it. times are in the cycles the cache has counted
+class WriteBuffer {
+private:
+    struct Entry {
+        Address block;
+        // the chunks of the block written, chunk_bits bytes each
+        uint64_t chunks;
+        // cycle the first of its stores came in at
+        uint64_t arrival;
+    };
+
+    std::vector<Entry> entries;
+    uint32_t head;
+    uint32_t count;
+    int block_bits;
+    int chunk_bits;
+    uint64_t memory_latency;
+    uint64_t word_cycles;
+    // the cycle the memory is done with the entries drained so far
+    uint64_t memory_free;
+
+    uint64_t start(const Entry& entry) const { return std::max(memory_free, entry.arrival); }
+    uint64_t finish(const Entry& entry) const { return start(entry) + drainCycles(entry); }
+    // the same cost as write-through stores pay without a buffer, for all
+    // the words at once
+    uint64_t drainCycles(const Entry& entry) const {
+        uint64_t bytes = uint64_t(__builtin_popcountll(entry.chunks)) << chunk_bits;
+        return memory_latency + word_cycles * std::max<uint64_t>(1, bytes / 4);
+    }
+    void pop() {
+        memory_free = finish(entries[head]);
+        head = (head + 1) % entries.size();
+        count--;
+    }
+
+public:
+    // what became of one store
+    struct Result {
+        // it went into an entry that was already there, else it took a new
+        // one, a memory transaction of its own
+        bool merged;
+        // cycles it waited for a free entry
+        uint64_t wait;
+    };
+
+    // no buffer at all with capacity 0
+    WriteBuffer(unsigned int capacity, int block_size, uint64_t memory_latency, uint64_t word_cycles)
+        : entries(capacity), head(0), count(0), block_bits(std::log2(block_size)),
+          // words, unless a block has more than 64 of them
+          chunk_bits(std::max(2, block_bits - 6)), memory_latency(memory_latency), word_cycles(word_cycles),
+          memory_free(0) {}
+
+    bool enabled() const { return !entries.empty(); }
+    uint32_t capacity() const { return entries.size(); }
+
+    // everything that finished draining by cycle now is gone
+    void retire(uint64_t now) {
+        while (count > 0 && finish(entries[head]) <= now) {
+            pop();
+        }
+    }
+
+    // a store to address at cycle now
+    Result store(Address address, uint64_t now) {
+        retire(now);
+
+        Address block = address >> block_bits;
+        uint64_t chunk = uint64_t(1) << ((address >> chunk_bits) & ((uint64_t(1) << (block_bits - chunk_bits)) - 1));
+        for (uint32_t i = 0; i < count; i++) {
+            Entry& entry = entries[(head + i) % entries.size()];
+            // the oldest entry cannot take more once its drain has begun
+            if (entry.block == block && (i > 0 || start(entry) > now)) {
+                entry.chunks |= chunk;
+                return Result{true, 0};
+            }
+        }
+
+        uint64_t wait = 0;
+        if (count == entries.size()) {
+            wait = finish(entries[head]) - now;
+            pop();
+        }
+        entries[(head + count) % entries.size()] = Entry{block, chunk, now + wait};
+        count++;
+        return Result{false, wait};
+    }
+
+    // a fill or writeback the cache waits for, needing the memory for cycles
+    // from cycle now. returns how long it waited for a drain under way
+    uint64_t transfer(uint64_t now, uint64_t cycles) {
+        retire(now);
+        if (count > 0 && start(entries[head]) <= now) {
+            pop();
+        }
+        uint64_t begin = std::max(memory_free, now);
+        memory_free = begin + cycles;
+        return begin - now;
+    }
+
+    // the cache's cycle count is starting over from 0 at cycle now
+    void restartClock(uint64_t now) {
+        memory_free = memory_free > now ? memory_free - now : 0;
+        for (uint32_t i = 0; i < count; i++) {
+            Entry& entry = entries[(head + i) % entries.size()];
+            entry.arrival = entry.arrival > now ? entry.arrival - now : 0;
+        }
+    }
+
+    template <typename Archive>
+    void checkpoint(Archive& archive) {
+        archive(entries);
+        archive(head);
+        archive(count);
+        archive(memory_free);
+    }
+};
+
+#endif